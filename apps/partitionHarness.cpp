@@ -0,0 +1,144 @@
+// Local multi-process check of BRep partitioning.
+//
+//   BRepPartitionHarness <model.brep> <count> [body|face] [outputDir]
+//
+// Splits the model into count chunks, writes each chunk to its own file and
+// launches one worker process per chunk.  Each worker loads only its chunk,
+// checks it is self contained and reports the faces it owns.  The driver then
+// verifies every face of the model is owned by exactly one chunk.
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "brep.h"
+
+namespace {
+std::string chunkFileName(const std::string &dir, std::size_t i) {
+  return dir + "/chunk_" + std::to_string(i) + ".brep";
+}
+
+int runWorker(const std::string &chunkFile, const std::string &resultFile) {
+  padt::brep::BRep brep;
+  if (!brep.buildBRepFromFile(chunkFile)) {
+    std::cerr << chunkFile << ": failed to load" << std::endl;
+    return 1;
+  }
+  const auto &info = brep.partitionInfo();
+  if (info.Count_ == 0) {
+    std::cerr << chunkFile << ": missing partition record" << std::endl;
+    return 1;
+  }
+  // Every face in the chunk, owned or ghost, must have all of its edges
+  std::set<padt::brep::EdgeHandle> edges(brep.edges().begin(),
+                                         brep.edges().end());
+  for (const auto fh : brep.faces()) {
+    for (const auto &eh : brep.faceEdges(fh)) {
+      if (edges.count(eh) == 0) {
+        std::cerr << chunkFile << ": face " << fh << " is missing edge " << eh
+                  << std::endl;
+        return 1;
+      }
+    }
+  }
+  std::ofstream out(resultFile);
+  out << info.Index_ << " " << info.Triangles_ << " " << info.Faces_.size();
+  for (const auto &fh : info.Faces_) {
+    out << " " << fh;
+  }
+  out << std::endl;
+  return out.good() ? 0 : 1;
+}
+
+int runDriver(const std::string &self, const std::string &model,
+              std::size_t count, padt::brep::PartitionLevel level,
+              const std::string &dir) {
+  padt::brep::BRep brep;
+  if (!brep.buildBRepFromFile(model)) {
+    std::cerr << model << ": failed to load" << std::endl;
+    return 1;
+  }
+  auto partitions = brep.partition(count, level);
+  for (const auto &p : partitions) {
+    if (!brep.writeBRepToFile(chunkFileName(dir, p.Index_), p)) {
+      std::cerr << "Failed to write chunk " << p.Index_ << std::endl;
+      return 1;
+    }
+  }
+
+  // One worker process per chunk, all running at once
+  std::vector<std::future<int>> workers;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::string command = "\"" + self + "\" --worker \"" +
+                          chunkFileName(dir, i) + "\" \"" +
+                          chunkFileName(dir, i) + ".result\"";
+    workers.push_back(std::async(std::launch::async, [command]() {
+      return std::system(command.c_str());
+    }));
+  }
+  bool success = true;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (workers[i].get() != 0) {
+      std::cerr << "Worker " << i << " failed" << std::endl;
+      success = false;
+    }
+  }
+  if (!success) {
+    return 1;
+  }
+
+  // Each face must be owned exactly once and no triangles lost
+  std::map<int, int> owners;
+  std::size_t triangles = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::ifstream in(chunkFileName(dir, i) + ".result");
+    std::size_t index, chunkTriangles, faceCount;
+    in >> index >> chunkTriangles >> faceCount;
+    triangles += chunkTriangles;
+    for (std::size_t f = 0; f < faceCount; ++f) {
+      int id;
+      in >> id;
+      owners[id]++;
+    }
+    std::cout << "chunk " << index << ": " << faceCount << " faces, "
+              << chunkTriangles << " triangles" << std::endl;
+  }
+  std::size_t expectedTriangles = 0;
+  for (const auto fh : brep.faces()) {
+    auto [fV, fF] = brep.faceGeometry(fh);
+    expectedTriangles += static_cast<std::size_t>(fF.rows());
+    if (owners[fh.idx()] != 1) {
+      std::cerr << "Face " << fh << " owned by " << owners[fh.idx()]
+                << " chunks" << std::endl;
+      success = false;
+    }
+  }
+  if (triangles != expectedTriangles) {
+    std::cerr << "Chunks hold " << triangles << " triangles, expected "
+              << expectedTriangles << std::endl;
+    success = false;
+  }
+  std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+  return success ? 0 : 1;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc == 4 && std::string(argv[1]) == "--worker") {
+    return runWorker(argv[2], argv[3]);
+  }
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <model.brep> <count> [body|face] [outputDir]" << std::endl;
+    return 1;
+  }
+  std::size_t count = std::stoul(argv[2]);
+  auto level = argc > 3 && std::string(argv[3]) == "face"
+                   ? padt::brep::PartitionLevel::Face
+                   : padt::brep::PartitionLevel::Body;
+  std::string dir = argc > 4 ? argv[4] : ".";
+  return runDriver(argv[0], argv[1], count, level, dir);
+}
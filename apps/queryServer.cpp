@@ -0,0 +1,348 @@
+// Local geometry query server for a single BRep shared by many clients.
+//
+//   BRepQueryServer <model.brep> <socket> [threads]
+//   BRepQueryServer <model.brep> <socket> --clients <count> [batches]
+//
+// Clients connect over a Unix domain socket and send varint delimited
+// QueryBatch messages; each is answered with one delimited QueryResultBatch.
+// Results may arrive out of order across batches and are matched by query id.
+// With --clients the server also starts count stand-in clients, checks their
+// answers against direct BRep calls and prints the latency histogram.
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "brep.h"
+#include "query.pb.h"
+#include "queryService.h"
+#include "utility.h"
+
+#ifdef _WIN32
+int main(int, char *argv[]) {
+  std::cerr << argv[0] << ": Unix domain sockets are not supported"
+            << std::endl;
+  return 1;
+}
+#else
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+using padt::brep::proto::Query;
+using padt::brep::proto::QueryBatch;
+using padt::brep::proto::QueryResultBatch;
+
+// One client connection.  Workers answering the connection's batches share
+// its output stream, so writes are serialised.  The socket is closed once
+// the reader and every outstanding batch have released the connection.
+struct Connection {
+  explicit Connection(int fd) : Fd_(fd), Out_(fd) {
+    Out_.SetCloseOnDelete(true);
+  }
+  int Fd_;
+  std::mutex WriteMutex_;
+  google::protobuf::io::FileOutputStream Out_;
+  // Set once a write fails; later results for the connection are dropped
+  bool Failed_ = false;
+};
+
+bool makeAddress(const std::string &path, sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << path << ": socket path too long" << std::endl;
+    return false;
+  }
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return true;
+}
+
+int listenOn(const std::string &path) {
+  sockaddr_un addr;
+  if (!makeAddress(path, addr)) {
+    return -1;
+  }
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  ::unlink(path.c_str());
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      ::listen(fd, SOMAXCONN) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int connectTo(const std::string &path) {
+  sockaddr_un addr;
+  if (!makeAddress(path, addr)) {
+    return -1;
+  }
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void serveConnection(padt::brep::QueryService &service, int fd) {
+  auto connection = std::make_shared<Connection>(fd);
+  google::protobuf::io::FileInputStream in(fd);
+  QueryBatch batch;
+  while (padt::pbio::readDelimitedFrom(&in, &batch)) {
+    service.submit(std::move(batch), [connection](QueryResultBatch &&results) {
+      std::lock_guard<std::mutex> lock(connection->WriteMutex_);
+      if (connection->Failed_) {
+        return;
+      }
+      if (!padt::pbio::writeDelimitedTo(results, &connection->Out_) ||
+          !connection->Out_.Flush()) {
+        // The client has gone; stop its reader as well
+        connection->Failed_ = true;
+        ::shutdown(connection->Fd_, SHUT_RDWR);
+      }
+    });
+    batch.Clear();
+  }
+  ::shutdown(fd, SHUT_RD);
+}
+
+// Runs until the listening socket is shut down.  Errors that only affect
+// one connection, or that clear once descriptors are released, are retried.
+void acceptLoop(padt::brep::QueryService &service, int listenFd) {
+  while (true) {
+    int fd = ::accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      switch (errno) {
+        case EINTR:
+        case ECONNABORTED:
+        case EPROTO:
+          continue;
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          continue;
+        default:
+          return;
+      }
+    }
+    std::thread([&service, fd]() { serveConnection(service, fd); }).detach();
+  }
+}
+
+// A random mix of bounding box and topology queries, answered directly
+// against the BRep so the client can check what the server returns.
+struct Expected {
+  Eigen::AlignedBox3d Box_;
+  std::size_t Handles_ = 0;
+};
+
+bool matches(const Expected &expected,
+             const padt::brep::proto::QueryResult &result) {
+  if (result.has_box()) {
+    const auto &b = result.box();
+    return expected.Box_.min() ==
+               Eigen::Vector3d(b.min().x(), b.min().y(), b.min().z()) &&
+           expected.Box_.max() ==
+               Eigen::Vector3d(b.max().x(), b.max().y(), b.max().z());
+  }
+  return result.has_handles() &&
+         expected.Handles_ ==
+             static_cast<std::size_t>(result.handles().ids_size());
+}
+
+Query randomQuery(const padt::brep::BRep &brep,
+                  const std::vector<padt::brep::FaceHandle> &faces,
+                  const std::vector<padt::brep::EdgeHandle> &edges,
+                  std::mt19937 &rng, Expected &expected) {
+  using padt::brep::proto::EntityType;
+  using padt::brep::proto::TopologyQuery;
+  Query query;
+  std::uniform_int_distribution<std::size_t> face(0, faces.size() - 1);
+  std::uniform_int_distribution<std::size_t> edge(0, edges.size() - 1);
+  switch (rng() % 4) {
+    case 0: {
+      auto fh = faces[face(rng)];
+      query.mutable_bounding_box()->set_type(EntityType::FACE);
+      query.mutable_bounding_box()->set_id(fh.idx());
+      expected.Box_ = brep.boundingBox(fh);
+      break;
+    }
+    case 1: {
+      auto eh = edges[edge(rng)];
+      query.mutable_bounding_box()->set_type(EntityType::EDGE);
+      query.mutable_bounding_box()->set_id(eh.idx());
+      expected.Box_ = brep.boundingBox(eh);
+      break;
+    }
+    case 2: {
+      auto fh = faces[face(rng)];
+      query.mutable_topology()->set_relation(TopologyQuery::FACE_EDGES);
+      query.mutable_topology()->set_id(fh.idx());
+      expected.Handles_ = brep.faceEdges(fh).size();
+      break;
+    }
+    default: {
+      auto eh = edges[edge(rng)];
+      query.mutable_topology()->set_relation(TopologyQuery::EDGE_FACES);
+      query.mutable_topology()->set_id(eh.idx());
+      expected.Handles_ = brep.edgeFaces(eh).size();
+      break;
+    }
+  }
+  return query;
+}
+
+bool runClient(const padt::brep::BRep &brep, const std::string &socketPath,
+               std::size_t client, std::size_t batches) {
+  int fd = connectTo(socketPath);
+  if (fd < 0) {
+    std::cerr << "client " << client << ": failed to connect" << std::endl;
+    return false;
+  }
+  std::vector<padt::brep::FaceHandle> faces(brep.faces().begin(),
+                                            brep.faces().end());
+  std::vector<padt::brep::EdgeHandle> edges(brep.edges().begin(),
+                                            brep.edges().end());
+  std::mt19937 rng(static_cast<unsigned>(client));
+  std::vector<QueryBatch> requests(batches);
+  std::vector<Expected> expected;
+  for (auto &batch : requests) {
+    std::size_t size = 1 + rng() % 8;
+    for (std::size_t i = 0; i < size; ++i) {
+      expected.emplace_back();
+      Query query = randomQuery(brep, faces, edges, rng, expected.back());
+      query.set_id(static_cast<std::int64_t>(expected.size() - 1));
+      *batch.add_queries() = std::move(query);
+    }
+  }
+
+  // Send everything up front so batches from all clients overlap in the
+  // server queue, and read the answers as they arrive
+  std::thread writer([fd, &requests]() {
+    google::protobuf::io::FileOutputStream out(fd);
+    for (const auto &batch : requests) {
+      padt::pbio::writeDelimitedTo(batch, &out);
+    }
+    out.Flush();
+  });
+  google::protobuf::io::FileInputStream in(fd);
+  std::vector<bool> answered(expected.size(), false);
+  bool success = true;
+  QueryResultBatch results;
+  for (std::size_t b = 0; b < batches; ++b) {
+    results.Clear();
+    if (!padt::pbio::readDelimitedFrom(&in, &results)) {
+      std::cerr << "client " << client << ": connection lost" << std::endl;
+      success = false;
+      break;
+    }
+    for (const auto &r : results.results()) {
+      auto id = static_cast<std::size_t>(r.id());
+      if (id >= expected.size() || answered[id]) {
+        std::cerr << "client " << client << ": unexpected result " << id
+                  << std::endl;
+        success = false;
+        continue;
+      }
+      answered[id] = true;
+      if (!matches(expected[id], r)) {
+        std::cerr << "client " << client << ": wrong answer to query " << id
+                  << std::endl;
+        success = false;
+      }
+    }
+  }
+  writer.join();
+  ::close(fd);
+  for (bool a : answered) {
+    success = success && a;
+  }
+  return success;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <model.brep> <socket> [threads]\n"
+              << "       " << argv[0]
+              << " <model.brep> <socket> --clients <count> [batches]"
+              << std::endl;
+    return 1;
+  }
+  std::string socketPath = argv[2];
+  bool selfTest = argc > 4 && std::string(argv[3]) == "--clients";
+  std::size_t threads = !selfTest && argc > 3 ? std::stoul(argv[3]) : 0;
+
+  // A client that disconnects with answers in flight must not take the
+  // server down; failed writes close its connection instead
+  std::signal(SIGPIPE, SIG_IGN);
+
+  padt::brep::BRep brep;
+  if (!brep.buildBRepFromFile(argv[1])) {
+    std::cerr << argv[1] << ": failed to load" << std::endl;
+    return 1;
+  }
+  padt::brep::QueryService service(brep, threads);
+  int listenFd = listenOn(socketPath);
+  if (listenFd < 0) {
+    std::cerr << socketPath << ": failed to listen" << std::endl;
+    return 1;
+  }
+  std::thread acceptor([&service, listenFd]() {
+    acceptLoop(service, listenFd);
+  });
+  if (!selfTest) {
+    acceptor.join();
+    return 0;
+  }
+
+  std::size_t clients = std::stoul(argv[4]);
+  std::size_t batches = argc > 5 ? std::stoul(argv[5]) : 1000;
+  std::atomic<bool> success{true};
+  std::vector<std::thread> standIns;
+  for (std::size_t c = 0; c < clients; ++c) {
+    standIns.emplace_back([&, c]() {
+      if (!runClient(brep, socketPath, c, batches)) {
+        success = false;
+      }
+    });
+  }
+  for (auto &t : standIns) {
+    t.join();
+  }
+  ::shutdown(listenFd, SHUT_RDWR);
+  ::close(listenFd);
+  acceptor.join();
+  service.stop();
+  ::unlink(socketPath.c_str());
+
+  const auto &latencies = service.latencies();
+  std::cout << service.batches() << " batches in " << service.dispatches()
+            << " dispatches" << std::endl;
+  for (double p : {50.0, 90.0, 99.0, 99.9}) {
+    std::cout << "p" << p << " <= " << latencies.percentile(p) << " us"
+              << std::endl;
+  }
+  std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+  return success ? 0 : 1;
+}
+#endif
@@ -23,17 +23,22 @@
 #define PADT_BREP_H
 
 #include <Eigen/Dense>
+#include <algorithm>
 #include <boost/range/adaptor/map.hpp>
 #include <map>
 #include <optional>
+#include <set>
 #include <string>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 #include "brep.pb.h"
+#include "compression.h"
 #include "entity.h"
 #include "entityRange.h"
 #include "handle.h"
+#include "instrumentation.h"
+#include "partition.h"
 
 
 namespace padt::brep {
@@ -57,6 +62,61 @@ class BRep {
   bool buildBRepFromFile(const std::string &filename);
   bool buildBRepFromEntityStream(
       const std::vector<padt::brep::proto::BRepEntity> &entities);
+  // Lay out the geometry of faces, edges and vertices along a Morton curve
+  // through their bounding boxes and reorder the facets of each face for
+  // vertex cache reuse.  Handles and face local connectivity stay valid.
+  void reorderGeometry();
+
+  // Delta functions.  Entity records in a delta add an entity or replace the
+  // one with the same id, Removed records delete entities.  Only the affected
+  // adjacency and the cached boxes above the changed entities are updated.
+  // Replaced geometry is left in place until it makes up half of a geometry
+  // matrix, at which point the matrices are compacted.
+  bool applyDeltaFromFile(const std::string &fileName);
+  bool applyEntityDelta(
+      const std::vector<padt::brep::proto::BRepEntity> &entities);
+  void compactGeometry();
+
+  // Serialization functions.  The output uses the same varint delimited
+  // BRepEntity stream read by buildBRepFromFile.  The handle overloads write
+  // only the given assembly, part or body and the entities below it, along
+  // with its parents listing only the written children.
+  bool writeBRepToFile(const std::string &fileName) const;
+  bool writeBRepToFile(const std::string &fileName,
+                       const AssemblyHandle &h) const;
+  bool writeBRepToFile(const std::string &fileName, const PartHandle &h) const;
+  bool writeBRepToFile(const std::string &fileName, const BodyHandle &h) const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream() const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream(
+      const AssemblyHandle &h) const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream(
+      const PartHandle &h) const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream(
+      const BodyHandle &h) const;
+  // The compressed encoding keeps the same topology records but moves face
+  // and edge geometry into GeometryChunk records of quantised, delta coded
+  // and LZ compressed columns, which are decoded in parallel on load.
+  // buildBRepFromFile reads either encoding.
+  bool writeCompressedBRepToFile(
+      const std::string &fileName,
+      const CompressionOptions &options = CompressionOptions()) const;
+
+  // Partitioning functions.  partition splits the BRep into count chunks
+  // along a Morton curve through the body or face bounding box centres,
+  // balanced by triangle count.  Each chunk can be written on its own and a
+  // BRep built from a chunk describes it through partitionInfo.
+  std::vector<Partition> partition(
+      std::size_t count, PartitionLevel level = PartitionLevel::Body) const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream(
+      const Partition &p) const;
+  bool writeBRepToFile(const std::string &fileName, const Partition &p) const;
+  const Partition &partitionInfo() const { return PartitionInfo_; }
+
+  // Introspection functions.  Timings and cache counters accumulate across
+  // builds until resetStatistics is called.
+  MemoryUsage memoryUsage() const;
+  BRepStatistics statistics() const;
+  void resetStatistics();
 
   // Bounding box functions
   Eigen::AlignedBox3d boundingBox(const AssemblyHandle &h) const;
@@ -64,6 +124,9 @@ class BRep {
   Eigen::AlignedBox3d boundingBox(const BodyHandle &h) const;
   Eigen::AlignedBox3d boundingBox(const FaceHandle &h) const;
   Eigen::AlignedBox3d boundingBox(const EdgeHandle &h) const;
+  // Fill every bounding box cache up front.  Afterwards boundingBox only
+  // reads the caches, so it may be called from several threads at once.
+  void buildBoundingBoxCaches() const;
 
   // Access functions
   auto assemblies() const { return boost::adaptors::keys(Assemblies_); }
@@ -71,6 +134,7 @@ class BRep {
   auto bodies() const { return boost::adaptors::keys(Bodies_); }
   auto faces() const { return boost::adaptors::keys(Faces_); }
   auto edges() const { return boost::adaptors::keys(Edges_); }
+  auto vertices() const { return boost::adaptors::keys(Vertices_); }
 
   const VertexHandle startVertex(const EdgeHandle &h) const {
     if (Edges_.count(h) > 0) {
@@ -104,6 +168,30 @@ class BRep {
     }
     return EmptyBodies_;
   }
+  const std::vector<PartHandle> &assemblyParts(const AssemblyHandle &h) const {
+    if (Assemblies_.count(h) > 0) {
+      return Assemblies_.at(h).Parts_;
+    }
+    return EmptyParts_;
+  }
+  const std::vector<FaceHandle> &edgeFaces(const EdgeHandle &h) const {
+    if (Edges_.count(h) > 0) {
+      return Edges_.at(h).Faces_;
+    }
+    return EmptyFaces_;
+  }
+  const std::vector<BodyHandle> &faceBodies(const FaceHandle &h) const {
+    if (Faces_.count(h) > 0) {
+      return Faces_.at(h).Bodies_;
+    }
+    return EmptyBodies_;
+  }
+  const std::vector<EdgeHandle> &vertexEdges(const VertexHandle &h) const {
+    if (Vertices_.count(h) > 0) {
+      return Vertices_.at(h).Edges_;
+    }
+    return EmptyEdges_;
+  }
 
   std::tuple<const Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 3>>,
              const Eigen::Block<const Eigen::Matrix<int, Eigen::Dynamic, 3>>>
@@ -140,7 +228,65 @@ class BRep {
         V_, startV, 0, sizeV, 3);
   }
 
+  const Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 3>>
+  vertexGeometry(const VertexHandle &h) const {
+    if (Vertices_.count(h) == 0) {
+      return Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 3>>(
+          EmptyV_, 0, 0, 0, 0);
+    }
+    return Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 3>>(
+        V_, Vertices_.at(h).PointIndex_, 0, 1, 3);
+  }
+
+  const Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 2>>
+  faceParameters(const FaceHandle &h) const {
+    if (Faces_.count(h) == 0) {
+      return Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 2>>(
+          EmptyUV_, 0, 0, 0, 0);
+    }
+    const auto &faceData = Faces_.at(h);
+    return Eigen::Block<const Eigen::Matrix<double, Eigen::Dynamic, 2>>(
+        FaceParams_, faceData.ParamStart_, 0, faceData.ParamSize_, 2);
+  }
+
+  const Eigen::VectorBlock<const Eigen::VectorXd> edgeParameters(
+      const EdgeHandle &h) const {
+    if (Edges_.count(h) == 0) {
+      return Eigen::VectorBlock<const Eigen::VectorXd>(EmptyT_, 0, 0);
+    }
+    const auto &edgeData = Edges_.at(h);
+    return Eigen::VectorBlock<const Eigen::VectorXd>(
+        EdgeParams_, edgeData.ParamStart_, edgeData.ParamSize_);
+  }
+
+  // Parameter space evaluation functions.  A face point is interpolated
+  // barycentrically from the facet containing (u,v) in parameter space and an
+  // edge point linearly between the curve samples bracketing t.  Queries
+  // outside the tessellated parameter range return no value.  The inverse
+  // mapping projects onto the closest facet of the face, found through a
+  // bounding volume tree over the facets.
+  std::optional<Eigen::Vector3d> pointAtParam(const FaceHandle &h,
+                                              const Eigen::Vector2d &uv) const;
+  std::optional<Eigen::Vector3d> pointAtParam(const EdgeHandle &h,
+                                              double t) const;
+  std::optional<Eigen::Vector2d> paramAtPoint(const FaceHandle &h,
+                                              const Eigen::Vector3d &p) const;
+
+  // Batched, multithreaded versions of the above.  Rows that cannot be
+  // evaluated are set to NaN.
+  Eigen::Matrix<double, Eigen::Dynamic, 3> pointsAtParams(
+      const FaceHandle &h,
+      const Eigen::Matrix<double, Eigen::Dynamic, 2> &uv) const;
+  Eigen::Matrix<double, Eigen::Dynamic, 3> pointsAtParams(
+      const EdgeHandle &h, const Eigen::VectorXd &t) const;
+  Eigen::Matrix<double, Eigen::Dynamic, 2> paramsAtPoints(
+      const FaceHandle &h,
+      const Eigen::Matrix<double, Eigen::Dynamic, 3> &p) const;
+
  private:
+  bool readEntitiesFromFile(
+      const std::string &fileName,
+      std::vector<padt::brep::proto::BRepEntity> &entities);
   void resetGeneratedHandleId(
       const std::vector<padt::brep::proto::BRepEntity> &entities);
   LoopHandle generateNewLoopHandle() {
@@ -160,7 +306,118 @@ class BRep {
   bool addFace(const padt::brep::proto::Face &face);
   bool addEdge(const padt::brep::proto::Edge &edge);
   bool addVertex(const padt::brep::proto::Vertex &vertex);
+  bool addPartition(const padt::brep::proto::Partition &partition);
+  bool addGeometryChunks(
+      const std::vector<const padt::brep::proto::GeometryChunk *> &chunks);
   bool buildBottomUpTopology();
+  void buildBodyEdgesAndVertices(const BodyHandle &h);
+  void buildPartitionInfo();
+
+  // Serialization helpers
+  struct EntitySelection {
+    std::set<AssemblyHandle> Assemblies_;
+    std::set<PartHandle> Parts_;
+    std::set<BodyHandle> Bodies_;
+    std::set<FaceHandle> Faces_;
+    std::set<EdgeHandle> Edges_;
+    std::set<VertexHandle> Vertices_;
+    const Partition *Partition_ = nullptr;
+    // Write face and edge geometry as compressed chunks
+    const CompressionOptions *Compression_ = nullptr;
+  };
+  EntitySelection selectAll() const;
+  void selectBelow(const AssemblyHandle &h, EntitySelection &s) const;
+  void selectBelow(const PartHandle &h, EntitySelection &s) const;
+  void selectBelow(const BodyHandle &h, EntitySelection &s) const;
+  // Add the parts and assemblies above the selected bodies, so a subset
+  // keeps its place in the hierarchy.  Their child lists are written
+  // filtered to the selection.
+  void selectAbove(EntitySelection &s) const;
+  void selectPartition(const Partition &p, EntitySelection &s) const;
+  std::vector<padt::brep::proto::BRepEntity> entityStream(
+      const EntitySelection &s) const;
+  bool writeBRepToFile(const std::string &fileName,
+                       const EntitySelection &s) const;
+  std::vector<padt::brep::proto::BRepEntity> makeGeometryChunks(
+      const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const AssemblyHandle &h,
+                                           const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const PartHandle &h,
+                                           const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const BodyHandle &h,
+                                           const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const FaceHandle &h,
+                                           const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const EdgeHandle &h,
+                                           const EntitySelection &s) const;
+  padt::brep::proto::BRepEntity makeEntity(const VertexHandle &h,
+                                           const EntitySelection &s) const;
+
+  // Parameter space helpers.  The grid buckets the facets of a face by the
+  // cells of a uniform grid over its (u,v) bounds, stored in compressed rows.
+  struct FaceParamGrid {
+    Eigen::AlignedBox2d Bounds_;
+    Eigen::Vector2d CellSize_;
+    Eigen::Index Cols_ = 0;
+    Eigen::Index Rows_ = 0;
+    std::vector<Eigen::Index> CellStart_;
+    std::vector<Eigen::Index> CellFacets_;
+  };
+  bool hasFaceParams(const FaceHandle &h) const;
+  bool hasEdgeParams(const EdgeHandle &h) const;
+  const FaceParamGrid &faceParamGrid(const FaceHandle &h) const;
+  std::optional<Eigen::Vector3d> pointAtParam(const FaceParamGrid &grid,
+                                              const FaceHandle &h,
+                                              const Eigen::Vector2d &uv) const;
+  // Bounding volume tree over the facets of a face for closest facet
+  // searches.  Nodes are stored depth first, so a node's first child follows
+  // it; leaves own a range of Facets_.
+  struct FacetTree {
+    struct Node {
+      Eigen::AlignedBox3d Box_;
+      Eigen::Index Second_ = 0;
+      Eigen::Index First_ = 0;
+      Eigen::Index Count_ = 0;
+    };
+    std::vector<Node> Nodes_;
+    std::vector<Eigen::Index> Facets_;
+  };
+  const FacetTree &faceFacetTree(const FaceHandle &h) const;
+  std::optional<Eigen::Vector2d> paramAtPoint(const FacetTree &tree,
+                                              const FaceHandle &h,
+                                              const Eigen::Vector3d &p) const;
+
+  // Delta helpers
+  struct DeltaChanges {
+    std::set<AssemblyHandle> Assemblies_;
+    std::set<PartHandle> Parts_;
+    std::set<BodyHandle> Bodies_;
+    std::set<FaceHandle> Faces_;
+    std::set<EdgeHandle> Edges_;
+  };
+  void removeEntities(const padt::brep::proto::Removed &removed,
+                      DeltaChanges &changes);
+  void mergeStagedEntities(BRep &staged, DeltaChanges &changes);
+  // Claim count rows past the used rows of a geometry matrix and return the
+  // first.  Capacity at least doubles when it runs out, so a run of appends
+  // costs time proportional to the rows appended.
+  template <typename MatrixT>
+  static Eigen::Index appendRows(MatrixT &m, Eigen::Index &used,
+                                 Eigen::Index count) {
+    Eigen::Index start = used;
+    if (start + count > m.rows()) {
+      m.conservativeResize(std::max(start + count, 2 * m.rows()), m.cols());
+    }
+    used = start + count;
+    return start;
+  }
+  // Release the spare rows of the geometry matrices
+  void trimGeometry();
+  void invalidateBoundingBox(const AssemblyHandle &h);
+  void invalidateBoundingBox(const PartHandle &h);
+  void invalidateBoundingBox(const BodyHandle &h);
+  void invalidateBoundingBox(const FaceHandle &h);
+  void invalidateBoundingBox(const EdgeHandle &h);
 
  private:
   // Geometry
@@ -170,6 +427,8 @@ class BRep {
   Eigen::VectorXd EdgeParams_;
   Eigen::Matrix<double, Eigen::Dynamic, 3> EmptyV_;
   Eigen::Matrix<int, Eigen::Dynamic, 3> EmptyF_;
+  Eigen::Matrix<double, Eigen::Dynamic, 2> EmptyUV_;
+  Eigen::VectorXd EmptyT_;
   // Topology structures
   struct AssemblyData {
     std::vector<PartHandle> Parts_;
@@ -177,6 +436,7 @@ class BRep {
 
   struct PartData {
     std::vector<BodyHandle> Bodies_;
+    std::vector<AssemblyHandle> Assemblies_;
   };
 
   struct BodyData {
@@ -184,6 +444,7 @@ class BRep {
     std::vector<ShellHandle> Shells_;
     std::vector<EdgeHandle> Edges_;
     std::vector<VertexHandle> Vertices_;
+    std::vector<PartHandle> Parts_;
   };
 
   struct FaceData {
@@ -253,6 +514,19 @@ class BRep {
 
   int GeneratedHandleId_;
 
+  // Rows of each geometry matrix in use.  The matrices may hold spare rows
+  // past these for appending.
+  Eigen::Index PointRows_ = 0;
+  Eigen::Index FacetRows_ = 0;
+  Eigen::Index FaceParamRows_ = 0;
+  Eigen::Index EdgeParamRows_ = 0;
+
+  // Geometry rows no longer referenced after a delta, reclaimed on compaction
+  Eigen::Index GarbagePoints_ = 0;
+  Eigen::Index GarbageFacets_ = 0;
+  Eigen::Index GarbageFaceParams_ = 0;
+  Eigen::Index GarbageEdgeParams_ = 0;
+
   // Bounding Box cached values
   mutable std::unordered_map<AssemblyHandle, Eigen::AlignedBox3d,
                              HandleHash<AssemblyHandle>>
@@ -269,6 +543,19 @@ class BRep {
   mutable std::unordered_map<EdgeHandle, Eigen::AlignedBox3d,
                              HandleHash<EdgeHandle>>
       EdgeBBoxCache_;
+
+  // Parameter space search structures, built on first use
+  mutable std::unordered_map<FaceHandle, FaceParamGrid, HandleHash<FaceHandle>>
+      FaceParamGridCache_;
+  mutable std::unordered_map<FaceHandle, FacetTree, HandleHash<FaceHandle>>
+      FaceFacetTreeCache_;
+
+  // Instrumentation, only updated when PADT_BREP_INSTRUMENTATION is defined
+  mutable PhaseTimings Timings_;
+  mutable BoundingBoxCacheCounters BBoxCacheCounters_;
+
+  // Set when the BRep was built from a partition chunk
+  Partition PartitionInfo_;
 };  // namespace padt::brep
 }  // namespace padt::brep
 
@@ -0,0 +1,64 @@
+#ifndef PADT_BREP_COMPRESSION_H
+#define PADT_BREP_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace padt::brep {
+/**
+ * Settings for the compressed file encoding.  Positions are quantised to
+ * PositionBits_ over the largest extent of the model and parameters to
+ * ParameterBits_ over the range of each chunk.
+ */
+struct CompressionOptions {
+  int PositionBits_ = 24;
+  int ParameterBits_ = 24;
+  // Points per geometry chunk.  Chunks are encoded and decoded in parallel.
+  std::size_t ChunkPoints_ = std::size_t(1) << 16;
+};
+
+// LZ77 block codec in the style of LZ4: byte aligned literal runs and
+// matches within a 64KB window, tuned for decode speed over ratio
+std::string lzCompress(const std::string &input);
+// Fails on corrupt input, including a rawSize that the input could not
+// expand to, rather than throwing
+bool lzDecompress(const std::string &input, std::size_t rawSize,
+                  std::string &output);
+
+// No byte of compressed input expands to more than 255 bytes of output
+inline std::size_t lzMaxRawSize(std::size_t compressedSize) {
+  return compressedSize * 255;
+}
+
+// Column encoding helpers
+inline std::uint64_t zigzagEncode(std::int64_t v) {
+  return (static_cast<std::uint64_t>(v) << 1) ^
+         static_cast<std::uint64_t>(v >> 63);
+}
+
+inline std::int64_t zigzagDecode(std::uint64_t v) {
+  return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+inline void putVarint(std::string &out, std::uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+inline bool getVarint(const char *&p, const char *end, std::uint64_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    auto byte = static_cast<std::uint8_t>(*p++);
+    v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace padt::brep
+#endif
@@ -0,0 +1,77 @@
+#ifndef PADT_BREP_GEODESIC_H
+#define PADT_BREP_GEODESIC_H
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "brep.h"
+
+namespace padt::brep {
+/**
+ * The seeds of one distance field: points on the body, snapped to the
+ * closest surface vertex, and whole edges.
+ */
+struct GeodesicSources {
+  std::vector<Eigen::Vector3d> Points_;
+  std::vector<EdgeHandle> Edges_;
+};
+
+/**
+ * Geodesic distances over the tessellated surface of one body, computed with
+ * the heat method.  The faces of the body are welded into one surface mesh
+ * along their shared edges, so distances flow across face boundaries.  Both
+ * linear systems are factorised once on construction and reused for every
+ * distance field; fields for several seed sets are solved in parallel.
+ * Vertices on a connected piece of surface without a seed are at infinity.
+ */
+class GeodesicDistance {
+ public:
+  GeodesicDistance(const BRep &brep, const BodyHandle &h);
+
+  bool isValid() const { return Valid_; }
+
+  // The welded surface mesh
+  const Eigen::Matrix<double, Eigen::Dynamic, 3> &vertices() const {
+    return V_;
+  }
+  const Eigen::Matrix<int, Eigen::Dynamic, 3> &triangles() const { return F_; }
+
+  // Distance to the nearest source for every mesh vertex
+  Eigen::VectorXd distance(const GeodesicSources &sources) const;
+  std::vector<Eigen::VectorXd> distances(
+      const std::vector<GeodesicSources> &sources) const;
+
+  // A distance field sampled at the points of a face or edge, in the same
+  // order as BRep::faceGeometry and BRep::edgeGeometry
+  Eigen::VectorXd faceDistances(const FaceHandle &h,
+                                const Eigen::VectorXd &field) const;
+  Eigen::VectorXd edgeDistances(const EdgeHandle &h,
+                                const Eigen::VectorXd &field) const;
+
+ private:
+  void weld(const BRep &brep, const BodyHandle &h);
+  void factorise();
+  Eigen::Index closestVertex(const Eigen::Vector3d &p) const;
+
+  bool Valid_ = false;
+  Eigen::Matrix<double, Eigen::Dynamic, 3> V_;
+  Eigen::Matrix<int, Eigen::Dynamic, 3> F_;
+  // Connected piece of surface each vertex belongs to
+  std::vector<int> Component_;
+  int ComponentCount_ = 0;
+  // Mesh vertex of each face and edge point
+  std::unordered_map<FaceHandle, std::vector<int>, HandleHash<FaceHandle>>
+      FaceVertices_;
+  std::unordered_map<EdgeHandle, std::vector<int>, HandleHash<EdgeHandle>>
+      EdgeVertices_;
+
+  double TimeStep_ = 0.0;
+  Eigen::VectorXd Mass_;
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> Heat_;
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> Poisson_;
+};
+}  // namespace padt::brep
+#endif
@@ -0,0 +1,225 @@
+#ifndef PADT_BREP_INSTRUMENTATION_H
+#define PADT_BREP_INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace padt::brep {
+/**
+ * Bytes held by a BRep, split by storage.  Matrix sizes are exact; map sizes
+ * are estimates of the node, bucket and owned vector allocations.
+ */
+struct MemoryUsage {
+  std::size_t Points_ = 0;
+  std::size_t Facets_ = 0;
+  std::size_t FaceParams_ = 0;
+  std::size_t EdgeParams_ = 0;
+
+  std::size_t Assemblies_ = 0;
+  std::size_t Parts_ = 0;
+  std::size_t Bodies_ = 0;
+  std::size_t Faces_ = 0;
+  std::size_t Edges_ = 0;
+  std::size_t Vertices_ = 0;
+  std::size_t Loops_ = 0;
+  std::size_t Shells_ = 0;
+
+  std::size_t AssemblyBBoxCache_ = 0;
+  std::size_t PartBBoxCache_ = 0;
+  std::size_t BodyBBoxCache_ = 0;
+  std::size_t FaceBBoxCache_ = 0;
+  std::size_t EdgeBBoxCache_ = 0;
+
+  std::size_t FaceParamGridCache_ = 0;
+  std::size_t FaceFacetTreeCache_ = 0;
+
+  std::size_t geometry() const {
+    return Points_ + Facets_ + FaceParams_ + EdgeParams_;
+  }
+  std::size_t topology() const {
+    return Assemblies_ + Parts_ + Bodies_ + Faces_ + Edges_ + Vertices_ +
+           Loops_ + Shells_;
+  }
+  std::size_t boundingBoxCaches() const {
+    return AssemblyBBoxCache_ + PartBBoxCache_ + BodyBBoxCache_ +
+           FaceBBoxCache_ + EdgeBBoxCache_;
+  }
+  std::size_t total() const {
+    return geometry() + topology() + boundingBoxCaches() +
+           FaceParamGridCache_ + FaceFacetTreeCache_;
+  }
+};
+
+/**
+ * Accumulated wall clock time in seconds spent in each load phase.  Bounding
+ * box time covers every cache miss, lazy or from buildBoundingBoxCaches.
+ */
+struct PhaseTimings {
+  double Parse_ = 0.0;
+  double AddEntity_ = 0.0;
+  double Topology_ = 0.0;
+  double BoundingBox_ = 0.0;
+};
+
+// Cache lookups may come from several reader threads at once, so the counts
+// are atomic.  Copies take a relaxed snapshot.
+struct CacheCounters {
+  std::atomic<std::uint64_t> Hits_{0};
+  std::atomic<std::uint64_t> Misses_{0};
+
+  CacheCounters() = default;
+  CacheCounters(const CacheCounters &other) { *this = other; }
+  CacheCounters &operator=(const CacheCounters &other) {
+    Hits_.store(other.Hits_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    Misses_.store(other.Misses_.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+    return *this;
+  }
+};
+
+struct BoundingBoxCacheCounters {
+  CacheCounters Assembly_;
+  CacheCounters Part_;
+  CacheCounters Body_;
+  CacheCounters Face_;
+  CacheCounters Edge_;
+};
+
+/**
+ * A snapshot of the introspection data for a BRep.  Timings and cache
+ * counters are only collected when the library is built with
+ * PADT_BREP_INSTRUMENTATION defined, otherwise they remain zero.
+ */
+struct BRepStatistics {
+  bool InstrumentationEnabled_ = false;
+  MemoryUsage Memory_;
+  PhaseTimings Timings_;
+  BoundingBoxCacheCounters BBoxCache_;
+
+  // Flatten into dotted metric names, e.g. "memory.geometry.points_bytes",
+  // for export to an external metrics system.
+  std::vector<std::pair<std::string, double>> metrics() const {
+    std::vector<std::pair<std::string, double>> m;
+    auto bytes = [&m](const std::string &name, std::size_t value) {
+      m.emplace_back("memory." + name + "_bytes", static_cast<double>(value));
+    };
+    bytes("geometry.points", Memory_.Points_);
+    bytes("geometry.facets", Memory_.Facets_);
+    bytes("geometry.face_params", Memory_.FaceParams_);
+    bytes("geometry.edge_params", Memory_.EdgeParams_);
+    bytes("topology.assemblies", Memory_.Assemblies_);
+    bytes("topology.parts", Memory_.Parts_);
+    bytes("topology.bodies", Memory_.Bodies_);
+    bytes("topology.faces", Memory_.Faces_);
+    bytes("topology.edges", Memory_.Edges_);
+    bytes("topology.vertices", Memory_.Vertices_);
+    bytes("topology.loops", Memory_.Loops_);
+    bytes("topology.shells", Memory_.Shells_);
+    bytes("bbox_cache.assembly", Memory_.AssemblyBBoxCache_);
+    bytes("bbox_cache.part", Memory_.PartBBoxCache_);
+    bytes("bbox_cache.body", Memory_.BodyBBoxCache_);
+    bytes("bbox_cache.face", Memory_.FaceBBoxCache_);
+    bytes("bbox_cache.edge", Memory_.EdgeBBoxCache_);
+    bytes("param_grid_cache.face", Memory_.FaceParamGridCache_);
+    bytes("facet_tree_cache.face", Memory_.FaceFacetTreeCache_);
+    bytes("total", Memory_.total());
+    if (!InstrumentationEnabled_) {
+      return m;
+    }
+    m.emplace_back("time.parse_seconds", Timings_.Parse_);
+    m.emplace_back("time.add_entity_seconds", Timings_.AddEntity_);
+    m.emplace_back("time.topology_seconds", Timings_.Topology_);
+    m.emplace_back("time.bbox_seconds", Timings_.BoundingBox_);
+    auto counters = [&m](const std::string &name, const CacheCounters &c) {
+      m.emplace_back("bbox_cache." + name + ".hits",
+                     static_cast<double>(c.Hits_.load()));
+      m.emplace_back("bbox_cache." + name + ".misses",
+                     static_cast<double>(c.Misses_.load()));
+    };
+    counters("assembly", BBoxCache_.Assembly_);
+    counters("part", BBoxCache_.Part_);
+    counters("body", BBoxCache_.Body_);
+    counters("face", BBoxCache_.Face_);
+    counters("edge", BBoxCache_.Edge_);
+    return m;
+  }
+};
+
+/**
+ * Adds the lifetime of the timer to the given accumulator in seconds.
+ */
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(double &seconds)
+      : Seconds_(seconds), Start_(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() {
+    Seconds_ += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - Start_)
+                    .count();
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+ private:
+  double &Seconds_;
+  std::chrono::steady_clock::time_point Start_;
+};
+
+// Times a phase whose functions call each other, such as the bounding box
+// of an assembly computing those of its parts.  Only the outermost scope on
+// a thread adds its time, so nested calls are not counted twice.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(double &seconds)
+      : Seconds_(seconds),
+        Previous_(active()),
+        Start_(std::chrono::steady_clock::now()) {
+    active() = &seconds;
+  }
+  ~PhaseTimer() {
+    active() = Previous_;
+    if (Previous_ != &Seconds_) {
+      Seconds_ += std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - Start_)
+                      .count();
+    }
+  }
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+ private:
+  static const double *&active() {
+    thread_local const double *phase = nullptr;
+    return phase;
+  }
+
+  double &Seconds_;
+  const double *Previous_;
+  std::chrono::steady_clock::time_point Start_;
+};
+}  // namespace padt::brep
+
+// Hot path hooks.  These expand to nothing unless PADT_BREP_INSTRUMENTATION
+// is defined so an uninstrumented build pays no cost.
+#ifdef PADT_BREP_INSTRUMENTATION
+#define PADT_BREP_CONCAT_IMPL(a, b) a##b
+#define PADT_BREP_CONCAT(a, b) PADT_BREP_CONCAT_IMPL(a, b)
+#define PADT_BREP_TIME_SCOPE(seconds) \
+  ::padt::brep::ScopedTimer PADT_BREP_CONCAT(padtBRepTimer, __LINE__)(seconds)
+#define PADT_BREP_TIME_PHASE(seconds) \
+  ::padt::brep::PhaseTimer PADT_BREP_CONCAT(padtBRepTimer, __LINE__)(seconds)
+#define PADT_BREP_COUNT(counter) \
+  ((void)(counter).fetch_add(1, std::memory_order_relaxed))
+#else
+#define PADT_BREP_TIME_SCOPE(seconds) ((void)0)
+#define PADT_BREP_TIME_PHASE(seconds) ((void)0)
+#define PADT_BREP_COUNT(counter) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PADT_BREP_PARALLEL_H
+#define PADT_BREP_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace padt::brep {
+/**
+ * Invoke f(i) for every i in [0, count) spread over the available hardware
+ * threads.  Each thread is handed one contiguous block of indices, so f must
+ * be safe to call concurrently for distinct indices.
+ */
+template <typename Function>
+void parallelFor(std::size_t count, Function &&f) {
+  std::size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads, count);
+  if (numThreads <= 1) {
+    for (std::size_t i = 0; i < count; ++i) {
+      f(i);
+    }
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+  std::size_t blockSize = (count + numThreads - 1) / numThreads;
+  for (std::size_t t = 0; t < numThreads; ++t) {
+    std::size_t first = t * blockSize;
+    std::size_t last = std::min(count, first + blockSize);
+    threads.emplace_back([first, last, &f]() {
+      for (std::size_t i = first; i < last; ++i) {
+        f(i);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+}  // namespace padt::brep
+#endif
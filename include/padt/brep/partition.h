@@ -0,0 +1,45 @@
+#ifndef PADT_BREP_PARTITION_H
+#define PADT_BREP_PARTITION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "handle.h"
+
+namespace padt::brep {
+/**
+ * The entity level at which a BRep is split.  Body partitions keep every body
+ * whole; face partitions may split a body across chunks.
+ */
+enum class PartitionLevel { Body, Face };
+
+/**
+ * One spatially coherent chunk of a BRep.  Faces and edges are owned by
+ * exactly one partition.  Ghosts are entities owned by another partition that
+ * the chunk carries so that its owned faces keep their neighbours across the
+ * partition boundary.  Entities that no face or edge leads to, such as
+ * isolated vertices and empty bodies, parts and assemblies, are listed
+ * separately and belong to the first partition.  All handle lists are sorted.
+ */
+struct Partition {
+  std::size_t Index_ = 0;
+  std::size_t Count_ = 0;
+  std::size_t Triangles_ = 0;
+  std::vector<FaceHandle> Faces_;
+  std::vector<EdgeHandle> Edges_;
+  std::vector<FaceHandle> GhostFaces_;
+  std::vector<EdgeHandle> GhostEdges_;
+  std::vector<VertexHandle> LooseVertices_;
+  std::vector<BodyHandle> LooseBodies_;
+  std::vector<PartHandle> LooseParts_;
+  std::vector<AssemblyHandle> LooseAssemblies_;
+
+  bool isGhost(const FaceHandle &h) const {
+    return std::binary_search(GhostFaces_.begin(), GhostFaces_.end(), h);
+  }
+  bool isGhost(const EdgeHandle &h) const {
+    return std::binary_search(GhostEdges_.begin(), GhostEdges_.end(), h);
+  }
+};
+}  // namespace padt::brep
+#endif
@@ -0,0 +1,98 @@
+#ifndef PADT_BREP_QUERY_SERVICE_H
+#define PADT_BREP_QUERY_SERVICE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "brep.h"
+#include "query.pb.h"
+
+namespace padt::brep {
+/**
+ * A lock free histogram of latencies.  Bucket 0 counts latencies under one
+ * microsecond and bucket i those in [2^(i-1), 2^i) microseconds.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t Buckets = 32;
+
+  LatencyHistogram() {
+    for (auto &c : Counts_) {
+      c.store(0, std::memory_order_relaxed);
+    }
+  }
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  void record(std::chrono::nanoseconds latency);
+  std::array<std::uint64_t, Buckets> counts() const;
+  std::uint64_t count() const;
+  // Upper bound in microseconds of the bucket holding percentile p in [0, 100]
+  double percentile(double p) const;
+  static double bucketUpperBound(std::size_t bucket);
+
+ private:
+  std::array<std::atomic<std::uint64_t>, Buckets> Counts_;
+};
+
+/**
+ * Answers batches of geometry queries against one shared, read only BRep.
+ * All bounding boxes are cached when the service starts, after which queries
+ * never modify the BRep and need no locking.  In an instrumented build they
+ * still bump the cache hit counters, which are atomic.  Submitted batches are
+ * queued for a pool of workers; a worker takes every waiting batch, up to a
+ * limit, each time it wakes so that many small requests share one dispatch.
+ * The BRep must outlive the service and must not be modified while it runs.
+ */
+class QueryService {
+ public:
+  typedef std::function<void(padt::brep::proto::QueryResultBatch &&)> Callback;
+
+  explicit QueryService(const BRep &brep, std::size_t numThreads = 0);
+  ~QueryService();
+  QueryService(const QueryService &) = delete;
+  QueryService &operator=(const QueryService &) = delete;
+
+  // Queue a batch.  done is called from a worker thread with the results,
+  // or straight away with a rejected batch once the service has stopped.
+  void submit(padt::brep::proto::QueryBatch batch, Callback done);
+  // Answer a batch on the calling thread
+  padt::brep::proto::QueryResultBatch execute(
+      const padt::brep::proto::QueryBatch &batch) const;
+  void stop();
+
+  // Time from submit until the results were delivered, per batch
+  const LatencyHistogram &latencies() const { return Latencies_; }
+  std::uint64_t batches() const { return Batches_.load(); }
+  std::uint64_t dispatches() const { return Dispatches_.load(); }
+
+ private:
+  struct Work {
+    padt::brep::proto::QueryBatch Batch_;
+    Callback Done_;
+    std::chrono::steady_clock::time_point Submitted_;
+  };
+  void workerLoop();
+  void answer(const padt::brep::proto::Query &query,
+              padt::brep::proto::QueryResult &result) const;
+
+  const BRep &BRep_;
+  std::mutex Mutex_;
+  std::condition_variable Ready_;
+  std::deque<Work> Queue_;
+  bool Stopping_ = false;
+  std::vector<std::thread> Workers_;
+  LatencyHistogram Latencies_;
+  std::atomic<std::uint64_t> Batches_{0};
+  std::atomic<std::uint64_t> Dispatches_{0};
+};
+}  // namespace padt::brep
+#endif
@@ -0,0 +1,39 @@
+#ifndef PADT_BREP_SPATIAL_ORDER_H
+#define PADT_BREP_SPATIAL_ORDER_H
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstdint>
+
+namespace padt::brep {
+/**
+ * Spread the low 21 bits of x so that two zero bits separate each bit.
+ */
+inline std::uint64_t spreadBits3(std::uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+/**
+ * The 63 bit Morton (Z-order) code of p quantised to 21 bits per axis over
+ * bounds.  Points outside the bounds are clamped onto them.
+ */
+inline std::uint64_t mortonCode(const Eigen::Vector3d &p,
+                                const Eigen::AlignedBox3d &bounds) {
+  constexpr double Scale = static_cast<double>((1 << 21) - 1);
+  Eigen::Vector3d extent = bounds.sizes();
+  std::uint64_t code = 0;
+  for (int i = 0; i < 3; ++i) {
+    double t = extent[i] > 0.0 ? (p[i] - bounds.min()[i]) / extent[i] : 0.0;
+    auto q = static_cast<std::uint64_t>(std::clamp(t, 0.0, 1.0) * Scale);
+    code |= spreadBits3(q) << i;
+  }
+  return code;
+}
+}  // namespace padt::brep
+#endif
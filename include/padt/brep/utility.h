@@ -5,7 +5,7 @@
 #include <google/protobuf/message_lite.h>
 namespace padt {
 namespace pbio {
-bool readDelimitedFrom(
+inline bool readDelimitedFrom(
 	google::protobuf::io::ZeroCopyInputStream* rawInput,
 	google::protobuf::MessageLite* message) {
 	// We create a new coded stream for each message.  Don't worry, this is fast,
@@ -31,6 +31,30 @@ bool readDelimitedFrom(
 
 	return true;
 }
+
+inline bool writeDelimitedTo(
+	const google::protobuf::MessageLite& message,
+	google::protobuf::io::ZeroCopyOutputStream* rawOutput) {
+	// We create a new coded stream for each message.  Don't worry, this is fast.
+	google::protobuf::io::CodedOutputStream output(rawOutput);
+
+	// Write the size.
+	const size_t size = message.ByteSizeLong();
+	output.WriteVarint32(static_cast<uint32_t>(size));
+
+	// Serialize the message directly into the stream's buffer when it fits,
+	// otherwise fall back to the slower streaming path.
+	uint8_t* buffer = output.GetDirectBufferForNBytesAndAdvance(
+		static_cast<int>(size));
+	if (buffer != nullptr) {
+		message.SerializeWithCachedSizesToArray(buffer);
+	} else {
+		message.SerializeWithCachedSizes(&output);
+		if (output.HadError()) return false;
+	}
+
+	return true;
+}
 }
 }
 #endif
@@ -31,6 +31,15 @@
 namespace padt::brep {
 
 void BRep::reset() {
+  V_.resize(0, 3);
+  F_.resize(0, 3);
+  FaceParams_.resize(0, 2);
+  EdgeParams_.resize(0);
+  PointRows_ = 0;
+  FacetRows_ = 0;
+  FaceParamRows_ = 0;
+  EdgeParamRows_ = 0;
+
   Assemblies_.clear();
   Parts_.clear();
   Bodies_.clear();
@@ -45,31 +54,47 @@ void BRep::reset() {
   BodyBBoxCache_.clear();
   FaceBBoxCache_.clear();
   EdgeBBoxCache_.clear();
+
+  FaceParamGridCache_.clear();
+  FaceFacetTreeCache_.clear();
+
+  PartitionInfo_ = Partition();
+
+  GarbagePoints_ = 0;
+  GarbageFacets_ = 0;
+  GarbageFaceParams_ = 0;
+  GarbageEdgeParams_ = 0;
 }
 
 
 bool BRep::buildBRepFromFile(const std::string &fileName) {
+  std::vector<padt::brep::proto::BRepEntity> entities;
+  if (!readEntitiesFromFile(fileName, entities)) {
+    return false;
+  }
+  // Delegate to the entity stream builder
+  return buildBRepFromEntityStream(entities);
+}
+
+bool BRep::readEntitiesFromFile(
+    const std::string &fileName,
+    std::vector<padt::brep::proto::BRepEntity> &entities) {
   // See if we can open the file
   std::ifstream in = std::ifstream(fileName, std::ios::binary);
   if (!in.is_open()) {
-    return {};
+    return false;
   }
   auto pbin = google::protobuf::io::IstreamInputStream(&in);
   auto pMessage = std::make_unique<padt::brep::proto::BRepEntity>();
-  BRep brep;
-  bool success = true;
-  std::vector<padt::brep::proto::BRepEntity> entities;
-  while (padt::pbio::readDelimitedFrom(&pbin, pMessage.get())) {
-    entities.push_back(*pMessage);
-    pMessage = std::make_unique<padt::brep::proto::BRepEntity>();
+  {
+    PADT_BREP_TIME_SCOPE(Timings_.Parse_);
+    while (padt::pbio::readDelimitedFrom(&pbin, pMessage.get())) {
+      entities.push_back(*pMessage);
+      pMessage = std::make_unique<padt::brep::proto::BRepEntity>();
+    }
   }
   // Make sure we read the whole file
-  if (!in.eof()) {
-    return false;
-  }
-  // Delegate to the entity stream builder
-  buildBRepFromEntityStream(entities);
-  return success;
+  return in.eof();
 }
 
 bool BRep::buildBRepFromEntityStream(
@@ -77,10 +102,25 @@ bool BRep::buildBRepFromEntityStream(
   reset();
   resetGeneratedHandleId(Entities);
   bool success = true;
-  std::for_each(
-      begin(Entities), end(Entities),
-      [&success, this](const auto &e) { success &= addBRepEntity(e); });
-  success &= buildBottomUpTopology();
+  {
+    PADT_BREP_TIME_SCOPE(Timings_.AddEntity_);
+    // Compressed geometry is decoded together once its entities exist
+    std::vector<const padt::brep::proto::GeometryChunk *> chunks;
+    for (const auto &e : Entities) {
+      if (e.has_geometry_chunk()) {
+        chunks.push_back(&e.geometry_chunk());
+      } else {
+        success &= addBRepEntity(e);
+      }
+    }
+    success &= addGeometryChunks(chunks);
+    trimGeometry();
+  }
+  {
+    PADT_BREP_TIME_SCOPE(Timings_.Topology_);
+    success &= buildBottomUpTopology();
+  }
+  buildPartitionInfo();
   return success;
 }
 
@@ -119,6 +159,13 @@ bool BRep::addBRepEntity(const padt::brep::proto::BRepEntity &entity) {
     return addEdge(entity.edge());
   } else if (entity.has_vertex()) {
     return addVertex(entity.vertex());
+  } else if (entity.has_partition()) {
+    return addPartition(entity.partition());
+  } else if (entity.has_geometry_chunk()) {
+    return addGeometryChunks({&entity.geometry_chunk()});
+  } else if (entity.has_removed()) {
+    std::cerr << "Removed records are only valid in a delta" << std::endl;
+    return false;
   } else {
     std::cerr << "Unknown message type" << std::endl;
     return false;
@@ -154,6 +201,9 @@ bool BRep::addBody(const padt::brep::proto::Body &body) {
         s.faces().begin(), s.faces().end(),
         std::back_inserter(shellData.Faces_),
         [](const auto &fId) -> FaceHandle { return FaceHandle(fId); });
+    ShellHandle sh = generateNewShellHandle();
+    data.Shells_.push_back(sh);
+    Shells_.insert_or_assign(sh, shellData);
   }
   Bodies_.insert_or_assign(BodyHandle(body.id()), data);
   return true;
@@ -162,9 +212,8 @@ bool BRep::addBody(const padt::brep::proto::Body &body) {
 bool BRep::addFace(const padt::brep::proto::Face &face) {
   FaceData data;
   // Add in the points
-  data.PointStart_ = V_.rows();
   data.PointSize_ = face.surface().points().size();
-  V_.conservativeResize(V_.rows() + data.PointSize_, 3);
+  data.PointStart_ = appendRows(V_, PointRows_, data.PointSize_);
   int row = data.PointStart_;
   for (auto v : face.surface().points()) {
     V_(row, 0) = v.x();
@@ -174,9 +223,8 @@ bool BRep::addFace(const padt::brep::proto::Face &face) {
   }
 
   // Add in the facets
-  data.FacetStart_ = F_.rows();
   data.FacetSize_ = face.surface().triangles().size();
-  F_.conservativeResize(F_.rows() + data.FacetSize_, 3);
+  data.FacetStart_ = appendRows(F_, FacetRows_, data.FacetSize_);
   row = data.FacetStart_;
   for (auto t : face.surface().triangles()) {
     F_(row, 0) = t.i();
@@ -185,9 +233,8 @@ bool BRep::addFace(const padt::brep::proto::Face &face) {
     row++;
   }
   // Add in the parameterization
-  data.ParamStart_ = FaceParams_.rows();
   data.ParamSize_ = face.surface().parameters().size();
-  FaceParams_.conservativeResize(FaceParams_.rows() + data.ParamSize_, 2);
+  data.ParamStart_ = appendRows(FaceParams_, FaceParamRows_, data.ParamSize_);
   row = data.ParamStart_;
   for (auto p : face.surface().parameters()) {
     FaceParams_(row, 0) = p.u();
@@ -215,9 +262,8 @@ bool BRep::addFace(const padt::brep::proto::Face &face) {
 
 bool BRep::addEdge(const padt::brep::proto::Edge &edge) {
   EdgeData data;
-  data.PointStart_ = V_.rows();
   data.PointSize_ = edge.curve().points().size();
-  V_.conservativeResize(V_.rows() + data.PointSize_, 3);
+  data.PointStart_ = appendRows(V_, PointRows_, data.PointSize_);
   int row = data.PointStart_;
   for (auto v : edge.curve().points()) {
     V_(row, 0) = v.x();
@@ -227,9 +273,8 @@ bool BRep::addEdge(const padt::brep::proto::Edge &edge) {
   }
 
   // Add in the parameterization
-  data.ParamStart_ = EdgeParams_.rows();
   data.ParamSize_ = edge.curve().parameters().size();
-  EdgeParams_.conservativeResize(EdgeParams_.rows() + data.ParamSize_, 1);
+  data.ParamStart_ = appendRows(EdgeParams_, EdgeParamRows_, data.ParamSize_);
   row = data.ParamStart_;
   for (auto p : edge.curve().parameters()) {
     EdgeParams_(row) = p;
@@ -246,8 +291,7 @@ bool BRep::addEdge(const padt::brep::proto::Edge &edge) {
 
 bool BRep::addVertex(const padt::brep::proto::Vertex &vertex) {
   VertexData data;
-  data.PointIndex_ = V_.rows();
-  V_.conservativeResize(V_.rows() + 1, 3);
+  data.PointIndex_ = appendRows(V_, PointRows_, 1);
   V_(data.PointIndex_, 0) = vertex.point().x();
   V_(data.PointIndex_, 1) = vertex.point().y();
   V_(data.PointIndex_, 2) = vertex.point().z();
@@ -255,6 +299,13 @@ bool BRep::addVertex(const padt::brep::proto::Vertex &vertex) {
   return true;
 }
 
+void BRep::trimGeometry() {
+  V_.conservativeResize(PointRows_, 3);
+  F_.conservativeResize(FacetRows_, 3);
+  FaceParams_.conservativeResize(FaceParamRows_, 2);
+  EdgeParams_.conservativeResize(EdgeParamRows_);
+}
+
 bool BRep::buildBottomUpTopology() {
   std::unordered_map<VertexHandle, std::set<EdgeHandle>,
                      HandleHash<VertexHandle>>
@@ -297,41 +348,76 @@ bool BRep::buildBottomUpTopology() {
               std::back_inserter(fData.Bodies_));
   }
 
-  // Build up the edges and vertices list for a given body
-  for (auto &[bH, bData] : Bodies_) {
-    std::set<EdgeHandle> bodyEdges;
-    for (const auto &fH : bData.Faces_) {
-      const auto &faceData = Faces_.at(fH);
-      std::copy(faceData.Edges_.begin(), faceData.Edges_.end(),
-                std::inserter(bodyEdges, bodyEdges.end()));
-    }
-    std::copy(bodyEdges.begin(), bodyEdges.end(),
-              std::back_inserter(bData.Edges_));
-    std::set<VertexHandle> bodyVertices;
-
-    for (const auto eH : bodyEdges) {
-      const auto &edgeData = Edges_.at(eH);
-      if (edgeData.startVertex_.isValid()) {
-        bodyVertices.insert(edgeData.startVertex_);
+  // Topology for mapping a body to the owning parts and a part to the
+  // owning assemblies
+  for (const auto &[pH, pData] : Parts_) {
+    for (const auto &bH : pData.Bodies_) {
+      if (Bodies_.count(bH) > 0) {
+        Bodies_.at(bH).Parts_.push_back(pH);
       }
-      if (edgeData.endVertex_.isValid()) {
-        bodyVertices.insert(edgeData.endVertex_);
+    }
+  }
+  for (const auto &[aH, aData] : Assemblies_) {
+    for (const auto &pH : aData.Parts_) {
+      if (Parts_.count(pH) > 0) {
+        Parts_.at(pH).Assemblies_.push_back(aH);
       }
     }
-    std::copy(bodyVertices.begin(), bodyVertices.end(),
-              std::back_inserter(bData.Vertices_));
+  }
+  for (auto &[bH, bData] : Bodies_) {
+    std::sort(bData.Parts_.begin(), bData.Parts_.end());
+  }
+  for (auto &[pH, pData] : Parts_) {
+    std::sort(pData.Assemblies_.begin(), pData.Assemblies_.end());
+  }
+
+  // Build up the edges and vertices list for a given body
+  for (const auto &[bH, bData] : Bodies_) {
+    buildBodyEdgesAndVertices(bH);
   }
 
   return true;
 }
 
+void BRep::buildBodyEdgesAndVertices(const BodyHandle &h) {
+  auto &bData = Bodies_.at(h);
+  std::set<EdgeHandle> bodyEdges;
+  for (const auto &fH : bData.Faces_) {
+    if (Faces_.count(fH) == 0) {
+      continue;
+    }
+    const auto &faceData = Faces_.at(fH);
+    std::copy(faceData.Edges_.begin(), faceData.Edges_.end(),
+              std::inserter(bodyEdges, bodyEdges.end()));
+  }
+  bData.Edges_.clear();
+  std::set<VertexHandle> bodyVertices;
+  for (const auto eH : bodyEdges) {
+    if (Edges_.count(eH) == 0) {
+      continue;
+    }
+    bData.Edges_.push_back(eH);
+    const auto &edgeData = Edges_.at(eH);
+    if (edgeData.startVertex_.isValid()) {
+      bodyVertices.insert(edgeData.startVertex_);
+    }
+    if (edgeData.endVertex_.isValid()) {
+      bodyVertices.insert(edgeData.endVertex_);
+    }
+  }
+  bData.Vertices_.assign(bodyVertices.begin(), bodyVertices.end());
+}
+
 Eigen::AlignedBox3d BRep::boundingBox(const AssemblyHandle &h) const {
   if (AssemblyBBoxCache_.count(h) > 0) {
+    PADT_BREP_COUNT(BBoxCacheCounters_.Assembly_.Hits_);
     return AssemblyBBoxCache_.at(h);
   }
+  PADT_BREP_COUNT(BBoxCacheCounters_.Assembly_.Misses_);
   if (Assemblies_.count(h) == 0) {
     return Eigen::AlignedBox3d();
   }
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
   const auto &assemblyData = Assemblies_.at(h);
   std::vector<Eigen::AlignedBox3d> boundingBoxes;
   std::transform(assemblyData.Parts_.begin(), assemblyData.Parts_.end(),
@@ -353,11 +439,14 @@ Eigen::AlignedBox3d BRep::boundingBox(const AssemblyHandle &h) const {
 
 Eigen::AlignedBox3d BRep::boundingBox(const PartHandle &h) const {
   if (PartBBoxCache_.count(h) > 0) {
+    PADT_BREP_COUNT(BBoxCacheCounters_.Part_.Hits_);
     return PartBBoxCache_.at(h);
   }
+  PADT_BREP_COUNT(BBoxCacheCounters_.Part_.Misses_);
   if (Parts_.count(h) == 0) {
     return Eigen::AlignedBox3d();
   }
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
   const auto &partData = Parts_.at(h);
   std::vector<Eigen::AlignedBox3d> boundingBoxes;
   std::transform(partData.Bodies_.begin(), partData.Bodies_.end(),
@@ -379,11 +468,14 @@ Eigen::AlignedBox3d BRep::boundingBox(const PartHandle &h) const {
 
 Eigen::AlignedBox3d BRep::boundingBox(const BodyHandle &h) const {
   if (BodyBBoxCache_.count(h) > 0) {
+    PADT_BREP_COUNT(BBoxCacheCounters_.Body_.Hits_);
     return BodyBBoxCache_.at(h);
   }
+  PADT_BREP_COUNT(BBoxCacheCounters_.Body_.Misses_);
   if (Bodies_.count(h) == 0) {
     return Eigen::AlignedBox3d();
   }
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
   const auto &bodyData = Bodies_.at(h);
   std::vector<Eigen::AlignedBox3d> boundingBoxes;
   std::transform(bodyData.Faces_.begin(), bodyData.Faces_.end(),
@@ -405,11 +497,14 @@ Eigen::AlignedBox3d BRep::boundingBox(const BodyHandle &h) const {
 
 Eigen::AlignedBox3d BRep::boundingBox(const FaceHandle &h) const {
   if (FaceBBoxCache_.count(h) > 0) {
+    PADT_BREP_COUNT(BBoxCacheCounters_.Face_.Hits_);
     return FaceBBoxCache_.at(h);
   }
+  PADT_BREP_COUNT(BBoxCacheCounters_.Face_.Misses_);
   if (Faces_.count(h) == 0) {
     return Eigen::AlignedBox3d();
   }
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
   auto [fV, fI] = faceGeometry(h);
   Eigen::Vector3d min = fV.colwise().minCoeff();
   Eigen::Vector3d max = fV.colwise().maxCoeff();
@@ -420,11 +515,14 @@ Eigen::AlignedBox3d BRep::boundingBox(const FaceHandle &h) const {
 
 Eigen::AlignedBox3d BRep::boundingBox(const EdgeHandle &h) const {
   if (EdgeBBoxCache_.count(h) > 0) {
+    PADT_BREP_COUNT(BBoxCacheCounters_.Edge_.Hits_);
     return EdgeBBoxCache_.at(h);
   }
+  PADT_BREP_COUNT(BBoxCacheCounters_.Edge_.Misses_);
   if (Edges_.count(h) == 0) {
     return Eigen::AlignedBox3d();
   }
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
   auto eV = edgeGeometry(h);
   Eigen::Vector3d min = eV.colwise().minCoeff();
   Eigen::Vector3d max = eV.colwise().maxCoeff();
@@ -432,4 +530,25 @@ Eigen::AlignedBox3d BRep::boundingBox(const EdgeHandle &h) const {
   EdgeBBoxCache_.insert_or_assign(h, bbox);
   return bbox;
 }
+
+void BRep::buildBoundingBoxCaches() const {
+  PADT_BREP_TIME_PHASE(Timings_.BoundingBox_);
+  for (const auto &eH : edges()) {
+    boundingBox(eH);
+  }
+  // Assemblies pull in their parts, bodies and faces, the rest catches
+  // anything not reachable from an assembly
+  for (const auto &aH : assemblies()) {
+    boundingBox(aH);
+  }
+  for (const auto &pH : parts()) {
+    boundingBox(pH);
+  }
+  for (const auto &bH : bodies()) {
+    boundingBox(bH);
+  }
+  for (const auto &fH : faces()) {
+    boundingBox(fH);
+  }
+}
 }  // namespace padt::brep
\ No newline at end of file
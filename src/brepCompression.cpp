@@ -0,0 +1,459 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+#include "brep.h"
+#include "brep.pb.h"
+#include "compression.h"
+#include "parallel.h"
+
+namespace padt::brep {
+
+namespace {
+// Grid spacing that spreads extent over the given number of bits
+double quantisationStep(double extent, int bits) {
+  double levels = std::ldexp(1.0, std::clamp(bits, 1, 52)) - 1.0;
+  return extent > 0.0 ? extent / levels : 1.0;
+}
+
+std::int64_t quantise(double value, double origin, double step) {
+  return std::llround((value - origin) / step);
+}
+
+// A column of integers stored as zigzag varint deltas
+class ColumnWriter {
+ public:
+  explicit ColumnWriter(std::string &out) : Out_(out) {}
+  void put(std::int64_t value) {
+    putVarint(Out_, zigzagEncode(value - Previous_));
+    Previous_ = value;
+  }
+
+ private:
+  std::string &Out_;
+  std::int64_t Previous_ = 0;
+};
+
+class ColumnReader {
+ public:
+  ColumnReader(const char *&p, const char *end) : P_(p), End_(end) {}
+  bool get(std::int64_t &value) {
+    std::uint64_t delta;
+    if (!getVarint(P_, End_, delta)) {
+      return false;
+    }
+    Previous_ += zigzagDecode(delta);
+    value = Previous_;
+    return true;
+  }
+
+ private:
+  const char *&P_;
+  const char *End_;
+  std::int64_t Previous_ = 0;
+};
+}  // namespace
+
+bool BRep::writeCompressedBRepToFile(const std::string &fileName,
+                                     const CompressionOptions &options) const {
+  EntitySelection s = selectAll();
+  s.Compression_ = &options;
+  return writeBRepToFile(fileName, s);
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::makeGeometryChunks(
+    const EntitySelection &s) const {
+  const CompressionOptions &options = *s.Compression_;
+  // Follow the storage order so that consecutive points lie close together
+  std::vector<FaceHandle> faces(s.Faces_.begin(), s.Faces_.end());
+  std::sort(faces.begin(), faces.end(), [this](const auto &a, const auto &b) {
+    return Faces_.at(a).PointStart_ < Faces_.at(b).PointStart_;
+  });
+  std::vector<EdgeHandle> edges(s.Edges_.begin(), s.Edges_.end());
+  std::sort(edges.begin(), edges.end(), [this](const auto &a, const auto &b) {
+    return Edges_.at(a).PointStart_ < Edges_.at(b).PointStart_;
+  });
+
+  // All chunks share one position grid so that points which coincide
+  // across faces and edges still coincide once decoded
+  Eigen::AlignedBox3d bounds;
+  auto extend = [this, &bounds](Eigen::Index start, Eigen::Index size) {
+    for (Eigen::Index row = start; row < start + size; ++row) {
+      bounds.extend(Eigen::Vector3d(V_.row(row).transpose()));
+    }
+  };
+  for (const auto &fH : faces) {
+    extend(Faces_.at(fH).PointStart_, Faces_.at(fH).PointSize_);
+  }
+  for (const auto &eH : edges) {
+    extend(Edges_.at(eH).PointStart_, Edges_.at(eH).PointSize_);
+  }
+  Eigen::Vector3d origin =
+      bounds.isEmpty() ? Eigen::Vector3d::Zero() : bounds.min();
+  double step = quantisationStep(
+      bounds.isEmpty() ? 0.0 : bounds.sizes().maxCoeff(),
+      options.PositionBits_);
+
+  struct ChunkEntities {
+    std::vector<FaceHandle> Faces_;
+    std::vector<EdgeHandle> Edges_;
+  };
+  std::vector<ChunkEntities> chunkEntities;
+  Eigen::Index chunkPoints = 0;
+  auto nextChunk = [&](Eigen::Index points) {
+    if (chunkEntities.empty() ||
+        chunkPoints >= static_cast<Eigen::Index>(options.ChunkPoints_)) {
+      chunkEntities.emplace_back();
+      chunkPoints = 0;
+    }
+    chunkPoints += points;
+    return &chunkEntities.back();
+  };
+  for (const auto &fH : faces) {
+    nextChunk(Faces_.at(fH).PointSize_)->Faces_.push_back(fH);
+  }
+  for (const auto &eH : edges) {
+    nextChunk(Edges_.at(eH).PointSize_)->Edges_.push_back(eH);
+  }
+
+  std::vector<padt::brep::proto::BRepEntity> chunks(chunkEntities.size());
+  parallelFor(chunkEntities.size(), [&](std::size_t i) {
+    const auto &entities = chunkEntities[i];
+    auto *chunk = chunks[i].mutable_geometry_chunk();
+    std::string raw;
+    std::int64_t points = 0, facets = 0, faceParams = 0, edgeParams = 0;
+    Eigen::AlignedBox2d uvBounds;
+    double tMin = std::numeric_limits<double>::max();
+    double tMax = std::numeric_limits<double>::lowest();
+    for (const auto &fH : entities.Faces_) {
+      const auto &faceData = Faces_.at(fH);
+      chunk->add_faces(fH.idx());
+      putVarint(raw, static_cast<std::uint64_t>(faceData.PointSize_));
+      putVarint(raw, static_cast<std::uint64_t>(faceData.FacetSize_));
+      putVarint(raw, static_cast<std::uint64_t>(faceData.ParamSize_));
+      points += faceData.PointSize_;
+      facets += faceData.FacetSize_;
+      faceParams += faceData.ParamSize_;
+      for (Eigen::Index row = faceData.ParamStart_;
+           row < faceData.ParamStart_ + faceData.ParamSize_; ++row) {
+        uvBounds.extend(Eigen::Vector2d(FaceParams_.row(row).transpose()));
+      }
+    }
+    for (const auto &eH : entities.Edges_) {
+      const auto &edgeData = Edges_.at(eH);
+      chunk->add_edges(eH.idx());
+      putVarint(raw, static_cast<std::uint64_t>(edgeData.PointSize_));
+      putVarint(raw, static_cast<std::uint64_t>(edgeData.ParamSize_));
+      points += edgeData.PointSize_;
+      edgeParams += edgeData.ParamSize_;
+      for (Eigen::Index row = edgeData.ParamStart_;
+           row < edgeData.ParamStart_ + edgeData.ParamSize_; ++row) {
+        tMin = std::min(tMin, EdgeParams_(row));
+        tMax = std::max(tMax, EdgeParams_(row));
+      }
+    }
+    Eigen::Vector2d uvMin =
+        uvBounds.isEmpty() ? Eigen::Vector2d::Zero() : uvBounds.min();
+    Eigen::Vector2d uvStep;
+    for (int a = 0; a < 2; ++a) {
+      uvStep[a] =
+          quantisationStep(uvBounds.isEmpty() ? 0.0 : uvBounds.sizes()[a],
+                           options.ParameterBits_);
+    }
+    if (edgeParams == 0) {
+      tMin = tMax = 0.0;
+    }
+    double tStep = quantisationStep(tMax - tMin, options.ParameterBits_);
+
+    // Columns: x, y and z of every point, facet indices, u, v and t
+    for (int a = 0; a < 3; ++a) {
+      ColumnWriter column(raw);
+      for (const auto &fH : entities.Faces_) {
+        const auto &faceData = Faces_.at(fH);
+        for (Eigen::Index row = faceData.PointStart_;
+             row < faceData.PointStart_ + faceData.PointSize_; ++row) {
+          column.put(quantise(V_(row, a), origin[a], step));
+        }
+      }
+      for (const auto &eH : entities.Edges_) {
+        const auto &edgeData = Edges_.at(eH);
+        for (Eigen::Index row = edgeData.PointStart_;
+             row < edgeData.PointStart_ + edgeData.PointSize_; ++row) {
+          column.put(quantise(V_(row, a), origin[a], step));
+        }
+      }
+    }
+    {
+      ColumnWriter column(raw);
+      for (const auto &fH : entities.Faces_) {
+        const auto &faceData = Faces_.at(fH);
+        for (Eigen::Index row = faceData.FacetStart_;
+             row < faceData.FacetStart_ + faceData.FacetSize_; ++row) {
+          for (int k = 0; k < 3; ++k) {
+            column.put(F_(row, k));
+          }
+        }
+      }
+    }
+    for (int a = 0; a < 2; ++a) {
+      ColumnWriter column(raw);
+      for (const auto &fH : entities.Faces_) {
+        const auto &faceData = Faces_.at(fH);
+        for (Eigen::Index row = faceData.ParamStart_;
+             row < faceData.ParamStart_ + faceData.ParamSize_; ++row) {
+          column.put(quantise(FaceParams_(row, a), uvMin[a], uvStep[a]));
+        }
+      }
+    }
+    {
+      ColumnWriter column(raw);
+      for (const auto &eH : entities.Edges_) {
+        const auto &edgeData = Edges_.at(eH);
+        for (Eigen::Index row = edgeData.ParamStart_;
+             row < edgeData.ParamStart_ + edgeData.ParamSize_; ++row) {
+          column.put(quantise(EdgeParams_(row), tMin, tStep));
+        }
+      }
+    }
+
+    chunk->set_point_count(points);
+    chunk->set_facet_count(facets);
+    chunk->set_face_param_count(faceParams);
+    chunk->set_edge_param_count(edgeParams);
+    chunk->mutable_origin()->set_x(origin.x());
+    chunk->mutable_origin()->set_y(origin.y());
+    chunk->mutable_origin()->set_z(origin.z());
+    chunk->set_step(step);
+    chunk->mutable_uv_min()->set_u(uvMin.x());
+    chunk->mutable_uv_min()->set_v(uvMin.y());
+    chunk->mutable_uv_step()->set_u(uvStep.x());
+    chunk->mutable_uv_step()->set_v(uvStep.y());
+    chunk->set_t_min(tMin);
+    chunk->set_t_step(tStep);
+    chunk->set_raw_size(static_cast<std::int64_t>(raw.size()));
+    chunk->set_data(lzCompress(raw));
+  });
+  return chunks;
+}
+
+bool BRep::addGeometryChunks(
+    const std::vector<const padt::brep::proto::GeometryChunk *> &chunks) {
+  // Give every chunk its own rows at the end of the geometry matrices, so
+  // the chunks can be decoded straight into place in parallel
+  struct ChunkLayout {
+    Eigen::Index PointStart_ = 0;
+    Eigen::Index FacetStart_ = 0;
+    Eigen::Index FaceParamStart_ = 0;
+    Eigen::Index EdgeParamStart_ = 0;
+    std::vector<FaceData *> Faces_;
+    std::vector<EdgeData *> Edges_;
+  };
+  std::vector<ChunkLayout> layouts(chunks.size());
+  // Chunks decode concurrently, so no entity may appear in two of them
+  std::set<FaceHandle> chunkFaces;
+  std::set<EdgeHandle> chunkEdges;
+  Eigen::Index points = PointRows_;
+  Eigen::Index facets = FacetRows_;
+  Eigen::Index faceParams = FaceParamRows_;
+  Eigen::Index edgeParams = EdgeParamRows_;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    const auto &chunk = *chunks[i];
+    auto &layout = layouts[i];
+    for (auto id : chunk.faces()) {
+      auto it = Faces_.find(FaceHandle(static_cast<int>(id)));
+      if (it == Faces_.end()) {
+        std::cerr << "Geometry chunk references unknown face " << id
+                  << std::endl;
+        return false;
+      }
+      if (!chunkFaces.insert(it->first).second) {
+        std::cerr << "Geometry chunks repeat face " << id << std::endl;
+        return false;
+      }
+      layout.Faces_.push_back(&it->second);
+    }
+    for (auto id : chunk.edges()) {
+      auto it = Edges_.find(EdgeHandle(static_cast<int>(id)));
+      if (it == Edges_.end()) {
+        std::cerr << "Geometry chunk references unknown edge " << id
+                  << std::endl;
+        return false;
+      }
+      if (!chunkEdges.insert(it->first).second) {
+        std::cerr << "Geometry chunks repeat edge " << id << std::endl;
+        return false;
+      }
+      layout.Edges_.push_back(&it->second);
+    }
+    // Every count and every column value takes at least one byte of the
+    // decoded chunk, which bounds the counts before any rows are allocated
+    auto validCount = [&chunk](std::int64_t count) {
+      return count >= 0 && count <= chunk.raw_size();
+    };
+    if (chunk.raw_size() < 0 ||
+        static_cast<std::uint64_t>(chunk.raw_size()) >
+            lzMaxRawSize(chunk.data().size()) ||
+        !validCount(chunk.point_count()) || !validCount(chunk.facet_count()) ||
+        !validCount(chunk.face_param_count()) ||
+        !validCount(chunk.edge_param_count()) ||
+        3 * chunk.point_count() + 3 * chunk.facet_count() +
+                2 * chunk.face_param_count() + chunk.edge_param_count() +
+                3 * chunk.faces_size() + 2 * chunk.edges_size() >
+            chunk.raw_size()) {
+      std::cerr << "Geometry chunk has invalid sizes" << std::endl;
+      return false;
+    }
+    layout.PointStart_ = points;
+    layout.FacetStart_ = facets;
+    layout.FaceParamStart_ = faceParams;
+    layout.EdgeParamStart_ = edgeParams;
+    points += chunk.point_count();
+    facets += chunk.facet_count();
+    faceParams += chunk.face_param_count();
+    edgeParams += chunk.edge_param_count();
+  }
+  try {
+    appendRows(V_, PointRows_, points - PointRows_);
+    appendRows(F_, FacetRows_, facets - FacetRows_);
+    appendRows(FaceParams_, FaceParamRows_, faceParams - FaceParamRows_);
+    appendRows(EdgeParams_, EdgeParamRows_, edgeParams - EdgeParamRows_);
+  } catch (const std::bad_alloc &) {
+    std::cerr << "Not enough memory for geometry chunks" << std::endl;
+    return false;
+  }
+
+  std::vector<char> decoded(chunks.size(), 0);
+  parallelFor(chunks.size(), [&](std::size_t i) {
+    const auto &chunk = *chunks[i];
+    const auto &layout = layouts[i];
+    std::string raw;
+    if (!lzDecompress(chunk.data(), static_cast<std::size_t>(chunk.raw_size()),
+                      raw)) {
+      return;
+    }
+    const char *p = raw.data();
+    const char *end = p + raw.size();
+
+    // Per entity counts place each entity within the chunk's rows
+    Eigen::Index point = layout.PointStart_;
+    Eigen::Index facet = layout.FacetStart_;
+    Eigen::Index faceParam = layout.FaceParamStart_;
+    Eigen::Index edgeParam = layout.EdgeParamStart_;
+    std::uint64_t pointSize, facetSize, paramSize;
+    for (auto *faceData : layout.Faces_) {
+      if (!getVarint(p, end, pointSize) || !getVarint(p, end, facetSize) ||
+          !getVarint(p, end, paramSize) ||
+          pointSize > static_cast<std::uint64_t>(chunk.point_count()) ||
+          facetSize > static_cast<std::uint64_t>(chunk.facet_count()) ||
+          paramSize > static_cast<std::uint64_t>(chunk.face_param_count())) {
+        return;
+      }
+      faceData->PointStart_ = point;
+      faceData->PointSize_ = static_cast<Eigen::Index>(pointSize);
+      faceData->FacetStart_ = facet;
+      faceData->FacetSize_ = static_cast<Eigen::Index>(facetSize);
+      faceData->ParamStart_ = faceParam;
+      faceData->ParamSize_ = static_cast<Eigen::Index>(paramSize);
+      point += faceData->PointSize_;
+      facet += faceData->FacetSize_;
+      faceParam += faceData->ParamSize_;
+    }
+    for (auto *edgeData : layout.Edges_) {
+      if (!getVarint(p, end, pointSize) || !getVarint(p, end, paramSize) ||
+          pointSize > static_cast<std::uint64_t>(chunk.point_count()) ||
+          paramSize > static_cast<std::uint64_t>(chunk.edge_param_count())) {
+        return;
+      }
+      edgeData->PointStart_ = point;
+      edgeData->PointSize_ = static_cast<Eigen::Index>(pointSize);
+      edgeData->ParamStart_ = edgeParam;
+      edgeData->ParamSize_ = static_cast<Eigen::Index>(paramSize);
+      point += edgeData->PointSize_;
+      edgeParam += edgeData->ParamSize_;
+    }
+    if (point != layout.PointStart_ + chunk.point_count() ||
+        facet != layout.FacetStart_ + chunk.facet_count() ||
+        faceParam != layout.FaceParamStart_ + chunk.face_param_count() ||
+        edgeParam != layout.EdgeParamStart_ + chunk.edge_param_count()) {
+      return;
+    }
+
+    std::int64_t q;
+    Eigen::Vector3d origin(chunk.origin().x(), chunk.origin().y(),
+                           chunk.origin().z());
+    for (int a = 0; a < 3; ++a) {
+      ColumnReader column(p, end);
+      for (Eigen::Index row = layout.PointStart_; row < point; ++row) {
+        if (!column.get(q)) {
+          return;
+        }
+        V_(row, a) = origin[a] + static_cast<double>(q) * chunk.step();
+      }
+    }
+    {
+      // Facets index the points of their own face
+      ColumnReader column(p, end);
+      for (const auto *faceData : layout.Faces_) {
+        for (Eigen::Index row = faceData->FacetStart_;
+             row < faceData->FacetStart_ + faceData->FacetSize_; ++row) {
+          for (int k = 0; k < 3; ++k) {
+            if (!column.get(q) || q < 0 || q >= faceData->PointSize_) {
+              return;
+            }
+            F_(row, k) = static_cast<int>(q);
+          }
+        }
+      }
+    }
+    double uvMin[2] = {chunk.uv_min().u(), chunk.uv_min().v()};
+    double uvStep[2] = {chunk.uv_step().u(), chunk.uv_step().v()};
+    for (int a = 0; a < 2; ++a) {
+      ColumnReader column(p, end);
+      for (Eigen::Index row = layout.FaceParamStart_; row < faceParam; ++row) {
+        if (!column.get(q)) {
+          return;
+        }
+        FaceParams_(row, a) = uvMin[a] + static_cast<double>(q) * uvStep[a];
+      }
+    }
+    {
+      ColumnReader column(p, end);
+      for (Eigen::Index row = layout.EdgeParamStart_; row < edgeParam; ++row) {
+        if (!column.get(q)) {
+          return;
+        }
+        EdgeParams_(row) =
+            chunk.t_min() + static_cast<double>(q) * chunk.t_step();
+      }
+    }
+    decoded[i] = p == end;
+  });
+  return std::find(decoded.begin(), decoded.end(), 0) == decoded.end();
+}
+}  // namespace padt::brep
@@ -0,0 +1,491 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "brep.h"
+#include "brep.pb.h"
+
+namespace padt::brep {
+
+namespace {
+// Adjacency lists built by buildBottomUpTopology are sorted; keep them so.
+template <typename HandleT>
+void insertSorted(std::vector<HandleT> &v, const HandleT &h) {
+  auto it = std::lower_bound(v.begin(), v.end(), h);
+  if (it == v.end() || *it != h) {
+    v.insert(it, h);
+  }
+}
+
+template <typename HandleT>
+void eraseValue(std::vector<HandleT> &v, const HandleT &h) {
+  v.erase(std::remove(v.begin(), v.end(), h), v.end());
+}
+
+// Elements of a that are not in b
+template <typename HandleT>
+std::vector<HandleT> difference(std::vector<HandleT> a,
+                                std::vector<HandleT> b) {
+  std::sort(a.begin(), a.end());
+  std::sort(b.begin(), b.end());
+  std::vector<HandleT> result;
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                      std::back_inserter(result));
+  return result;
+}
+}  // namespace
+
+bool BRep::applyDeltaFromFile(const std::string &fileName) {
+  std::vector<padt::brep::proto::BRepEntity> entities;
+  if (!readEntitiesFromFile(fileName, entities)) {
+    return false;
+  }
+  return applyEntityDelta(entities);
+}
+
+bool BRep::applyEntityDelta(
+    const std::vector<padt::brep::proto::BRepEntity> &entities) {
+  // Build the added and replaced entities into a staging BRep so that their
+  // geometry can be appended to ours in one step
+  BRep staged;
+  staged.GeneratedHandleId_ = GeneratedHandleId_;
+  bool success = true;
+  DeltaChanges changes;
+  {
+    PADT_BREP_TIME_SCOPE(Timings_.AddEntity_);
+    for (const auto &e : entities) {
+      if (e.has_removed()) {
+        removeEntities(e.removed(), changes);
+      } else if (!e.has_partition()) {
+        success &= staged.addBRepEntity(e);
+      }
+    }
+    GeneratedHandleId_ = staged.GeneratedHandleId_;
+  }
+  {
+    PADT_BREP_TIME_SCOPE(Timings_.Topology_);
+    mergeStagedEntities(staged, changes);
+    for (const auto &bH : changes.Bodies_) {
+      if (Bodies_.count(bH) > 0) {
+        buildBodyEdgesAndVertices(bH);
+      }
+    }
+  }
+
+  // Drop the cached boxes of everything changed and of whatever contains it
+  for (const auto &h : changes.Edges_) invalidateBoundingBox(h);
+  for (const auto &h : changes.Faces_) invalidateBoundingBox(h);
+  for (const auto &h : changes.Bodies_) invalidateBoundingBox(h);
+  for (const auto &h : changes.Parts_) invalidateBoundingBox(h);
+  for (const auto &h : changes.Assemblies_) invalidateBoundingBox(h);
+
+  if (2 * GarbagePoints_ > PointRows_ || 2 * GarbageFacets_ > FacetRows_ ||
+      2 * GarbageFaceParams_ > FaceParamRows_ ||
+      2 * GarbageEdgeParams_ > EdgeParamRows_) {
+    compactGeometry();
+  }
+  return success;
+}
+
+void BRep::removeEntities(const padt::brep::proto::Removed &removed,
+                          DeltaChanges &changes) {
+  for (auto id : removed.assemblies()) {
+    AssemblyHandle aH(id);
+    if (Assemblies_.count(aH) == 0) {
+      continue;
+    }
+    for (const auto &pH : Assemblies_.at(aH).Parts_) {
+      if (Parts_.count(pH) > 0) {
+        eraseValue(Parts_.at(pH).Assemblies_, aH);
+      }
+    }
+    Assemblies_.erase(aH);
+    AssemblyBBoxCache_.erase(aH);
+  }
+  for (auto id : removed.parts()) {
+    PartHandle pH(id);
+    if (Parts_.count(pH) == 0) {
+      continue;
+    }
+    const auto &partData = Parts_.at(pH);
+    for (const auto &bH : partData.Bodies_) {
+      if (Bodies_.count(bH) > 0) {
+        eraseValue(Bodies_.at(bH).Parts_, pH);
+      }
+    }
+    for (const auto &aH : partData.Assemblies_) {
+      eraseValue(Assemblies_.at(aH).Parts_, pH);
+      changes.Assemblies_.insert(aH);
+    }
+    Parts_.erase(pH);
+    PartBBoxCache_.erase(pH);
+  }
+  for (auto id : removed.bodies()) {
+    BodyHandle bH(id);
+    if (Bodies_.count(bH) == 0) {
+      continue;
+    }
+    const auto &bodyData = Bodies_.at(bH);
+    for (const auto &fH : bodyData.Faces_) {
+      if (Faces_.count(fH) > 0) {
+        eraseValue(Faces_.at(fH).Bodies_, bH);
+      }
+    }
+    for (const auto &pH : bodyData.Parts_) {
+      eraseValue(Parts_.at(pH).Bodies_, bH);
+      changes.Parts_.insert(pH);
+    }
+    for (const auto &sH : bodyData.Shells_) {
+      Shells_.erase(sH);
+    }
+    Bodies_.erase(bH);
+    BodyBBoxCache_.erase(bH);
+  }
+  for (auto id : removed.faces()) {
+    FaceHandle fH(id);
+    if (Faces_.count(fH) == 0) {
+      continue;
+    }
+    const auto &faceData = Faces_.at(fH);
+    for (const auto &eH : faceData.Edges_) {
+      if (Edges_.count(eH) > 0) {
+        eraseValue(Edges_.at(eH).Faces_, fH);
+      }
+    }
+    for (const auto &bH : faceData.Bodies_) {
+      auto &bodyData = Bodies_.at(bH);
+      eraseValue(bodyData.Faces_, fH);
+      for (const auto &sH : bodyData.Shells_) {
+        eraseValue(Shells_.at(sH).Faces_, fH);
+      }
+      changes.Bodies_.insert(bH);
+    }
+    for (const auto &lH : faceData.Loops_) {
+      Loops_.erase(lH);
+    }
+    GarbagePoints_ += faceData.PointSize_;
+    GarbageFacets_ += faceData.FacetSize_;
+    GarbageFaceParams_ += faceData.ParamSize_;
+    Faces_.erase(fH);
+    FaceBBoxCache_.erase(fH);
+    FaceParamGridCache_.erase(fH);
+    FaceFacetTreeCache_.erase(fH);
+  }
+  for (auto id : removed.edges()) {
+    EdgeHandle eH(id);
+    if (Edges_.count(eH) == 0) {
+      continue;
+    }
+    const auto &edgeData = Edges_.at(eH);
+    for (const auto &vH : {edgeData.startVertex_, edgeData.endVertex_}) {
+      if (Vertices_.count(vH) > 0) {
+        eraseValue(Vertices_.at(vH).Edges_, eH);
+      }
+    }
+    for (const auto &fH : edgeData.Faces_) {
+      auto &faceData = Faces_.at(fH);
+      eraseValue(faceData.Edges_, eH);
+      for (const auto &lH : faceData.Loops_) {
+        eraseValue(Loops_.at(lH).Edges_, eH);
+      }
+      changes.Bodies_.insert(faceData.Bodies_.begin(), faceData.Bodies_.end());
+    }
+    GarbagePoints_ += edgeData.PointSize_;
+    GarbageEdgeParams_ += edgeData.ParamSize_;
+    Edges_.erase(eH);
+    EdgeBBoxCache_.erase(eH);
+  }
+  for (auto id : removed.vertices()) {
+    VertexHandle vH(id);
+    if (Vertices_.count(vH) == 0) {
+      continue;
+    }
+    for (const auto &eH : Vertices_.at(vH).Edges_) {
+      auto &edgeData = Edges_.at(eH);
+      if (edgeData.startVertex_ == vH) {
+        edgeData.startVertex_.reset();
+      }
+      if (edgeData.endVertex_ == vH) {
+        edgeData.endVertex_.reset();
+      }
+      for (const auto &fH : edgeData.Faces_) {
+        const auto &faceBodies = Faces_.at(fH).Bodies_;
+        changes.Bodies_.insert(faceBodies.begin(), faceBodies.end());
+      }
+    }
+    GarbagePoints_ += 1;
+    Vertices_.erase(vH);
+  }
+}
+
+void BRep::mergeStagedEntities(BRep &staged, DeltaChanges &changes) {
+  // Append the staged geometry into the spare rows of each matrix, so the
+  // cost follows the size of the delta rather than the model
+  const Eigen::Index pointOffset =
+      appendRows(V_, PointRows_, staged.PointRows_);
+  V_.middleRows(pointOffset, staged.PointRows_) =
+      staged.V_.topRows(staged.PointRows_);
+  const Eigen::Index facetOffset =
+      appendRows(F_, FacetRows_, staged.FacetRows_);
+  F_.middleRows(facetOffset, staged.FacetRows_) =
+      staged.F_.topRows(staged.FacetRows_);
+  const Eigen::Index faceParamOffset =
+      appendRows(FaceParams_, FaceParamRows_, staged.FaceParamRows_);
+  FaceParams_.middleRows(faceParamOffset, staged.FaceParamRows_) =
+      staged.FaceParams_.topRows(staged.FaceParamRows_);
+  const Eigen::Index edgeParamOffset =
+      appendRows(EdgeParams_, EdgeParamRows_, staged.EdgeParamRows_);
+  EdgeParams_.segment(edgeParamOffset, staged.EdgeParamRows_) =
+      staged.EdgeParams_.head(staged.EdgeParamRows_);
+
+  // Merge bottom up so that each level can link to the level below it
+  for (auto &[vH, data] : staged.Vertices_) {
+    data.PointIndex_ += pointOffset;
+    if (Vertices_.count(vH) > 0) {
+      data.Edges_ = Vertices_.at(vH).Edges_;
+      GarbagePoints_ += 1;
+    }
+    Vertices_.insert_or_assign(vH, std::move(data));
+  }
+
+  for (auto &[eH, data] : staged.Edges_) {
+    data.PointStart_ += pointOffset;
+    data.ParamStart_ += edgeParamOffset;
+    if (Edges_.count(eH) > 0) {
+      const auto &old = Edges_.at(eH);
+      data.Faces_ = old.Faces_;
+      GarbagePoints_ += old.PointSize_;
+      GarbageEdgeParams_ += old.ParamSize_;
+      for (const auto &vH : {old.startVertex_, old.endVertex_}) {
+        if (Vertices_.count(vH) > 0) {
+          eraseValue(Vertices_.at(vH).Edges_, eH);
+        }
+      }
+      // The vertex lists of the bodies using this edge may change
+      for (const auto &fH : old.Faces_) {
+        const auto &faceBodies = Faces_.at(fH).Bodies_;
+        changes.Bodies_.insert(faceBodies.begin(), faceBodies.end());
+      }
+    }
+    for (const auto &vH : {data.startVertex_, data.endVertex_}) {
+      if (Vertices_.count(vH) > 0) {
+        insertSorted(Vertices_.at(vH).Edges_, eH);
+      }
+    }
+    Edges_.insert_or_assign(eH, std::move(data));
+    changes.Edges_.insert(eH);
+  }
+
+  for (auto &[fH, data] : staged.Faces_) {
+    data.PointStart_ += pointOffset;
+    data.FacetStart_ += facetOffset;
+    data.ParamStart_ += faceParamOffset;
+    std::vector<EdgeHandle> oldEdges;
+    if (Faces_.count(fH) > 0) {
+      const auto &old = Faces_.at(fH);
+      oldEdges = old.Edges_;
+      data.Bodies_ = old.Bodies_;
+      GarbagePoints_ += old.PointSize_;
+      GarbageFacets_ += old.FacetSize_;
+      GarbageFaceParams_ += old.ParamSize_;
+      for (const auto &lH : old.Loops_) {
+        Loops_.erase(lH);
+      }
+    }
+    for (const auto &eH : difference(oldEdges, data.Edges_)) {
+      if (Edges_.count(eH) > 0) {
+        eraseValue(Edges_.at(eH).Faces_, fH);
+      }
+    }
+    for (const auto &eH : difference(data.Edges_, oldEdges)) {
+      if (Edges_.count(eH) > 0) {
+        insertSorted(Edges_.at(eH).Faces_, fH);
+      }
+    }
+    for (const auto &lH : data.Loops_) {
+      Loops_.insert_or_assign(lH, std::move(staged.Loops_.at(lH)));
+    }
+    changes.Bodies_.insert(data.Bodies_.begin(), data.Bodies_.end());
+    Faces_.insert_or_assign(fH, std::move(data));
+    changes.Faces_.insert(fH);
+    FaceParamGridCache_.erase(fH);
+    FaceFacetTreeCache_.erase(fH);
+  }
+
+  for (auto &[bH, data] : staged.Bodies_) {
+    std::vector<FaceHandle> oldFaces;
+    if (Bodies_.count(bH) > 0) {
+      const auto &old = Bodies_.at(bH);
+      oldFaces = old.Faces_;
+      data.Parts_ = old.Parts_;
+      for (const auto &sH : old.Shells_) {
+        Shells_.erase(sH);
+      }
+    }
+    for (const auto &fH : difference(oldFaces, data.Faces_)) {
+      if (Faces_.count(fH) > 0) {
+        eraseValue(Faces_.at(fH).Bodies_, bH);
+      }
+    }
+    for (const auto &fH : difference(data.Faces_, oldFaces)) {
+      if (Faces_.count(fH) > 0) {
+        insertSorted(Faces_.at(fH).Bodies_, bH);
+      }
+    }
+    for (const auto &sH : data.Shells_) {
+      Shells_.insert_or_assign(sH, std::move(staged.Shells_.at(sH)));
+    }
+    Bodies_.insert_or_assign(bH, std::move(data));
+    changes.Bodies_.insert(bH);
+  }
+
+  for (auto &[pH, data] : staged.Parts_) {
+    std::vector<BodyHandle> oldBodies;
+    if (Parts_.count(pH) > 0) {
+      const auto &old = Parts_.at(pH);
+      oldBodies = old.Bodies_;
+      data.Assemblies_ = old.Assemblies_;
+    }
+    for (const auto &bH : difference(oldBodies, data.Bodies_)) {
+      if (Bodies_.count(bH) > 0) {
+        eraseValue(Bodies_.at(bH).Parts_, pH);
+      }
+    }
+    for (const auto &bH : difference(data.Bodies_, oldBodies)) {
+      if (Bodies_.count(bH) > 0) {
+        insertSorted(Bodies_.at(bH).Parts_, pH);
+      }
+    }
+    Parts_.insert_or_assign(pH, std::move(data));
+    changes.Parts_.insert(pH);
+  }
+
+  for (auto &[aH, data] : staged.Assemblies_) {
+    std::vector<PartHandle> oldParts;
+    if (Assemblies_.count(aH) > 0) {
+      oldParts = Assemblies_.at(aH).Parts_;
+    }
+    for (const auto &pH : difference(oldParts, data.Parts_)) {
+      if (Parts_.count(pH) > 0) {
+        eraseValue(Parts_.at(pH).Assemblies_, aH);
+      }
+    }
+    for (const auto &pH : difference(data.Parts_, oldParts)) {
+      if (Parts_.count(pH) > 0) {
+        insertSorted(Parts_.at(pH).Assemblies_, aH);
+      }
+    }
+    Assemblies_.insert_or_assign(aH, std::move(data));
+    changes.Assemblies_.insert(aH);
+  }
+}
+
+void BRep::invalidateBoundingBox(const AssemblyHandle &h) {
+  AssemblyBBoxCache_.erase(h);
+}
+
+void BRep::invalidateBoundingBox(const PartHandle &h) {
+  PartBBoxCache_.erase(h);
+  if (Parts_.count(h) > 0) {
+    for (const auto &aH : Parts_.at(h).Assemblies_) {
+      invalidateBoundingBox(aH);
+    }
+  }
+}
+
+void BRep::invalidateBoundingBox(const BodyHandle &h) {
+  BodyBBoxCache_.erase(h);
+  if (Bodies_.count(h) > 0) {
+    for (const auto &pH : Bodies_.at(h).Parts_) {
+      invalidateBoundingBox(pH);
+    }
+  }
+}
+
+void BRep::invalidateBoundingBox(const FaceHandle &h) {
+  FaceBBoxCache_.erase(h);
+  if (Faces_.count(h) > 0) {
+    for (const auto &bH : Faces_.at(h).Bodies_) {
+      invalidateBoundingBox(bH);
+    }
+  }
+}
+
+void BRep::invalidateBoundingBox(const EdgeHandle &h) {
+  EdgeBBoxCache_.erase(h);
+}
+
+void BRep::compactGeometry() {
+  // (old start, size, start to update) for each range of a matrix
+  typedef std::tuple<Eigen::Index, Eigen::Index, Eigen::Index *> Range;
+  std::vector<Range> points, facets, faceParams, edgeParams;
+  for (auto &[fH, data] : Faces_) {
+    points.emplace_back(data.PointStart_, data.PointSize_, &data.PointStart_);
+    facets.emplace_back(data.FacetStart_, data.FacetSize_, &data.FacetStart_);
+    faceParams.emplace_back(data.ParamStart_, data.ParamSize_,
+                            &data.ParamStart_);
+  }
+  for (auto &[eH, data] : Edges_) {
+    points.emplace_back(data.PointStart_, data.PointSize_, &data.PointStart_);
+    edgeParams.emplace_back(data.ParamStart_, data.ParamSize_,
+                            &data.ParamStart_);
+  }
+  for (auto &[vH, data] : Vertices_) {
+    points.emplace_back(data.PointIndex_, 1, &data.PointIndex_);
+  }
+  // Copy the live ranges over in their current order
+  auto compact = [](std::vector<Range> &ranges, auto &m) {
+    std::sort(ranges.begin(), ranges.end());
+    Eigen::Index rows = 0;
+    for (const auto &[start, size, update] : ranges) {
+      rows += std::max<Eigen::Index>(size, 0);
+    }
+    std::decay_t<decltype(m)> compacted(rows, m.cols());
+    Eigen::Index row = 0;
+    for (auto &[start, size, update] : ranges) {
+      if (size <= 0) {
+        continue;
+      }
+      compacted.middleRows(row, size) = m.middleRows(start, size);
+      *update = row;
+      row += size;
+    }
+    m.swap(compacted);
+  };
+  compact(points, V_);
+  compact(facets, F_);
+  compact(faceParams, FaceParams_);
+  compact(edgeParams, EdgeParams_);
+  PointRows_ = V_.rows();
+  FacetRows_ = F_.rows();
+  FaceParamRows_ = FaceParams_.rows();
+  EdgeParamRows_ = EdgeParams_.rows();
+
+  GarbagePoints_ = 0;
+  GarbageFacets_ = 0;
+  GarbageFaceParams_ = 0;
+  GarbageEdgeParams_ = 0;
+}
+}  // namespace padt::brep
@@ -0,0 +1,431 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "brep.h"
+#include "parallel.h"
+
+namespace padt::brep {
+
+namespace {
+// Barycentric coordinates below -ParamTolerance reject a facet.  Allows for
+// points lying exactly on a shared facet boundary.
+constexpr double ParamTolerance = 1e-9;
+
+// Most facets in a leaf of a face's facet tree
+constexpr Eigen::Index LeafFacets = 4;
+
+// Barycentric coordinates of p in the 2D triangle (a, b, c).  Returns false
+// for degenerate triangles.
+bool barycentric2d(const Eigen::Vector2d &p, const Eigen::Vector2d &a,
+                   const Eigen::Vector2d &b, const Eigen::Vector2d &c,
+                   Eigen::Vector3d &lambda) {
+  Eigen::Vector2d v0 = b - a;
+  Eigen::Vector2d v1 = c - a;
+  Eigen::Vector2d v2 = p - a;
+  double d = v0.x() * v1.y() - v1.x() * v0.y();
+  if (std::abs(d) <= std::numeric_limits<double>::min()) {
+    return false;
+  }
+  lambda[1] = (v2.x() * v1.y() - v1.x() * v2.y()) / d;
+  lambda[2] = (v0.x() * v2.y() - v2.x() * v0.y()) / d;
+  lambda[0] = 1.0 - lambda[1] - lambda[2];
+  return true;
+}
+
+// Closest point to p on the 3D triangle (a, b, c), returned as barycentric
+// coordinates.  See Ericson, Real-Time Collision Detection, 5.1.5.
+Eigen::Vector3d closestPointBarycentric(const Eigen::Vector3d &p,
+                                        const Eigen::Vector3d &a,
+                                        const Eigen::Vector3d &b,
+                                        const Eigen::Vector3d &c) {
+  Eigen::Vector3d ab = b - a;
+  Eigen::Vector3d ac = c - a;
+  Eigen::Vector3d ap = p - a;
+  double d1 = ab.dot(ap);
+  double d2 = ac.dot(ap);
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    return Eigen::Vector3d(1.0, 0.0, 0.0);
+  }
+  Eigen::Vector3d bp = p - b;
+  double d3 = ab.dot(bp);
+  double d4 = ac.dot(bp);
+  if (d3 >= 0.0 && d4 <= d3) {
+    return Eigen::Vector3d(0.0, 1.0, 0.0);
+  }
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    double v = d1 / (d1 - d3);
+    return Eigen::Vector3d(1.0 - v, v, 0.0);
+  }
+  Eigen::Vector3d cp = p - c;
+  double d5 = ab.dot(cp);
+  double d6 = ac.dot(cp);
+  if (d6 >= 0.0 && d5 <= d6) {
+    return Eigen::Vector3d(0.0, 0.0, 1.0);
+  }
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    double w = d2 / (d2 - d6);
+    return Eigen::Vector3d(1.0 - w, 0.0, w);
+  }
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return Eigen::Vector3d(0.0, 1.0 - w, w);
+  }
+  double denom = 1.0 / (va + vb + vc);
+  double v = vb * denom;
+  double w = vc * denom;
+  return Eigen::Vector3d(1.0 - v - w, v, w);
+}
+
+Eigen::Index gridCell(double x, double min, double size, Eigen::Index n) {
+  auto i = static_cast<Eigen::Index>(std::floor((x - min) / size));
+  return std::clamp<Eigen::Index>(i, 0, n - 1);
+}
+}  // namespace
+
+bool BRep::hasFaceParams(const FaceHandle &h) const {
+  if (Faces_.count(h) == 0) {
+    return false;
+  }
+  const auto &faceData = Faces_.at(h);
+  return faceData.ParamSize_ > 0 &&
+         faceData.ParamSize_ == faceData.PointSize_ && faceData.FacetSize_ > 0;
+}
+
+bool BRep::hasEdgeParams(const EdgeHandle &h) const {
+  if (Edges_.count(h) == 0) {
+    return false;
+  }
+  const auto &edgeData = Edges_.at(h);
+  return edgeData.ParamSize_ > 0 && edgeData.ParamSize_ == edgeData.PointSize_;
+}
+
+const BRep::FaceParamGrid &BRep::faceParamGrid(const FaceHandle &h) const {
+  auto cached = FaceParamGridCache_.find(h);
+  if (cached != FaceParamGridCache_.end()) {
+    return cached->second;
+  }
+  auto [fV, fF] = faceGeometry(h);
+  auto uv = faceParameters(h);
+  FaceParamGrid grid;
+  grid.Bounds_ = Eigen::AlignedBox2d(uv.colwise().minCoeff().transpose(),
+                                     uv.colwise().maxCoeff().transpose());
+  // Roughly one facet per cell
+  Eigen::Index n = std::max<Eigen::Index>(
+      1, static_cast<Eigen::Index>(std::ceil(std::sqrt(fF.rows()))));
+  grid.Cols_ = n;
+  grid.Rows_ = n;
+  grid.CellSize_ = grid.Bounds_.sizes() / static_cast<double>(n);
+  for (int i = 0; i < 2; ++i) {
+    if (grid.CellSize_[i] <= 0.0) {
+      grid.CellSize_[i] = 1.0;
+    }
+  }
+
+  // Two passes over the facets, first counting then filling each cell
+  auto cellRange = [&](Eigen::Index f) {
+    Eigen::AlignedBox2d box;
+    for (int k = 0; k < 3; ++k) {
+      box.extend(uv.row(fF(f, k)).transpose());
+    }
+    return std::make_tuple(
+        gridCell(box.min().x(), grid.Bounds_.min().x(), grid.CellSize_.x(),
+                 grid.Cols_),
+        gridCell(box.max().x(), grid.Bounds_.min().x(), grid.CellSize_.x(),
+                 grid.Cols_),
+        gridCell(box.min().y(), grid.Bounds_.min().y(), grid.CellSize_.y(),
+                 grid.Rows_),
+        gridCell(box.max().y(), grid.Bounds_.min().y(), grid.CellSize_.y(),
+                 grid.Rows_));
+  };
+  grid.CellStart_.assign(grid.Cols_ * grid.Rows_ + 1, 0);
+  for (Eigen::Index f = 0; f < fF.rows(); ++f) {
+    auto [i0, i1, j0, j1] = cellRange(f);
+    for (Eigen::Index j = j0; j <= j1; ++j) {
+      for (Eigen::Index i = i0; i <= i1; ++i) {
+        grid.CellStart_[j * grid.Cols_ + i + 1]++;
+      }
+    }
+  }
+  std::partial_sum(grid.CellStart_.begin(), grid.CellStart_.end(),
+                   grid.CellStart_.begin());
+  grid.CellFacets_.resize(grid.CellStart_.back());
+  std::vector<Eigen::Index> fill(grid.CellStart_.begin(),
+                                 grid.CellStart_.end() - 1);
+  for (Eigen::Index f = 0; f < fF.rows(); ++f) {
+    auto [i0, i1, j0, j1] = cellRange(f);
+    for (Eigen::Index j = j0; j <= j1; ++j) {
+      for (Eigen::Index i = i0; i <= i1; ++i) {
+        grid.CellFacets_[fill[j * grid.Cols_ + i]++] = f;
+      }
+    }
+  }
+  return FaceParamGridCache_.insert_or_assign(h, std::move(grid)).first->second;
+}
+
+std::optional<Eigen::Vector3d> BRep::pointAtParam(
+    const FaceHandle &h, const Eigen::Vector2d &uv) const {
+  if (!hasFaceParams(h)) {
+    return {};
+  }
+  return pointAtParam(faceParamGrid(h), h, uv);
+}
+
+std::optional<Eigen::Vector3d> BRep::pointAtParam(
+    const FaceParamGrid &grid, const FaceHandle &h,
+    const Eigen::Vector2d &uv) const {
+  Eigen::AlignedBox2d bounds = grid.Bounds_;
+  bounds.extend(bounds.min() - grid.CellSize_ * ParamTolerance);
+  bounds.extend(bounds.max() + grid.CellSize_ * ParamTolerance);
+  if (!bounds.contains(uv)) {
+    return {};
+  }
+  auto [fV, fF] = faceGeometry(h);
+  auto fUV = faceParameters(h);
+  Eigen::Index i = gridCell(uv.x(), grid.Bounds_.min().x(), grid.CellSize_.x(),
+                            grid.Cols_);
+  Eigen::Index j = gridCell(uv.y(), grid.Bounds_.min().y(), grid.CellSize_.y(),
+                            grid.Rows_);
+  Eigen::Index cell = j * grid.Cols_ + i;
+  for (Eigen::Index c = grid.CellStart_[cell]; c < grid.CellStart_[cell + 1];
+       ++c) {
+    Eigen::Index f = grid.CellFacets_[c];
+    Eigen::Vector3d lambda;
+    if (!barycentric2d(uv, fUV.row(fF(f, 0)).transpose(),
+                       fUV.row(fF(f, 1)).transpose(),
+                       fUV.row(fF(f, 2)).transpose(), lambda)) {
+      continue;
+    }
+    if (lambda.minCoeff() >= -ParamTolerance) {
+      Eigen::Vector3d p = lambda[0] * fV.row(fF(f, 0)).transpose() +
+                          lambda[1] * fV.row(fF(f, 1)).transpose() +
+                          lambda[2] * fV.row(fF(f, 2)).transpose();
+      return p;
+    }
+  }
+  return {};
+}
+
+std::optional<Eigen::Vector3d> BRep::pointAtParam(const EdgeHandle &h,
+                                                  double t) const {
+  if (!hasEdgeParams(h)) {
+    return {};
+  }
+  auto eV = edgeGeometry(h);
+  auto eT = edgeParameters(h);
+  const Eigen::Index n = eT.size();
+  const double *first = eT.data();
+  const double *last = first + n;
+  // The samples are monotone but run backwards for reversed curves
+  const bool ascending = eT[n - 1] >= eT[0];
+  const double tMin = ascending ? eT[0] : eT[n - 1];
+  const double tMax = ascending ? eT[n - 1] : eT[0];
+  if (!std::isfinite(t) || t < tMin || t > tMax) {
+    return {};
+  }
+  if (n == 1) {
+    return Eigen::Vector3d(eV.row(0).transpose());
+  }
+  const double *upper =
+      ascending ? std::upper_bound(first, last, t)
+                : std::upper_bound(first, last, t, std::greater<double>());
+  Eigen::Index i1 = std::clamp<Eigen::Index>(upper - first, 1, n - 1);
+  Eigen::Index i0 = i1 - 1;
+  double span = eT[i1] - eT[i0];
+  double s = span != 0.0 ? (t - eT[i0]) / span : 0.0;
+  Eigen::Vector3d p =
+      (1.0 - s) * eV.row(i0).transpose() + s * eV.row(i1).transpose();
+  return p;
+}
+
+const BRep::FacetTree &BRep::faceFacetTree(const FaceHandle &h) const {
+  auto cached = FaceFacetTreeCache_.find(h);
+  if (cached != FaceFacetTreeCache_.end()) {
+    return cached->second;
+  }
+  auto [fV, fF] = faceGeometry(h);
+  std::vector<Eigen::AlignedBox3d> boxes(fF.rows());
+  for (Eigen::Index f = 0; f < fF.rows(); ++f) {
+    for (int k = 0; k < 3; ++k) {
+      boxes[f].extend(fV.row(fF(f, k)).transpose());
+    }
+  }
+  FacetTree tree;
+  tree.Facets_.resize(fF.rows());
+  std::iota(tree.Facets_.begin(), tree.Facets_.end(), 0);
+  tree.Nodes_.reserve(2 * tree.Facets_.size() / LeafFacets + 1);
+  // Split each node at the median facet centre along its longest axis
+  std::function<void(Eigen::Index, Eigen::Index)> build =
+      [&](Eigen::Index first, Eigen::Index count) {
+        auto node = static_cast<Eigen::Index>(tree.Nodes_.size());
+        tree.Nodes_.emplace_back();
+        Eigen::AlignedBox3d box, centres;
+        for (Eigen::Index i = first; i < first + count; ++i) {
+          box.extend(boxes[tree.Facets_[i]]);
+          centres.extend(boxes[tree.Facets_[i]].center());
+        }
+        tree.Nodes_[node].Box_ = box;
+        if (count <= LeafFacets) {
+          tree.Nodes_[node].First_ = first;
+          tree.Nodes_[node].Count_ = count;
+          return;
+        }
+        Eigen::Index axis;
+        centres.sizes().maxCoeff(&axis);
+        auto begin = tree.Facets_.begin() + first;
+        std::nth_element(begin, begin + count / 2, begin + count,
+                         [&](Eigen::Index a, Eigen::Index b) {
+                           return boxes[a].center()[axis] <
+                                  boxes[b].center()[axis];
+                         });
+        build(first, count / 2);
+        tree.Nodes_[node].Second_ = static_cast<Eigen::Index>(
+            tree.Nodes_.size());
+        build(first + count / 2, count - count / 2);
+      };
+  build(0, static_cast<Eigen::Index>(tree.Facets_.size()));
+  return FaceFacetTreeCache_.insert_or_assign(h, std::move(tree)).first->second;
+}
+
+std::optional<Eigen::Vector2d> BRep::paramAtPoint(
+    const FaceHandle &h, const Eigen::Vector3d &p) const {
+  if (!hasFaceParams(h)) {
+    return {};
+  }
+  return paramAtPoint(faceFacetTree(h), h, p);
+}
+
+std::optional<Eigen::Vector2d> BRep::paramAtPoint(
+    const FacetTree &tree, const FaceHandle &h,
+    const Eigen::Vector3d &p) const {
+  if (!p.allFinite()) {
+    return {};
+  }
+  auto [fV, fF] = faceGeometry(h);
+  auto fUV = faceParameters(h);
+  double bestDistance = std::numeric_limits<double>::infinity();
+  Eigen::Vector2d best;
+  // Nodes waiting to be searched, with the squared distance to their box.
+  // The nearer child is searched first and anything further than the best
+  // facet so far is skipped.
+  std::vector<std::pair<double, Eigen::Index>> stack;
+  stack.emplace_back(tree.Nodes_[0].Box_.squaredExteriorDistance(p), 0);
+  while (!stack.empty()) {
+    auto [boxDistance, n] = stack.back();
+    stack.pop_back();
+    if (boxDistance >= bestDistance) {
+      continue;
+    }
+    const auto &node = tree.Nodes_[n];
+    if (node.Count_ == 0) {
+      std::pair<double, Eigen::Index> first(
+          tree.Nodes_[n + 1].Box_.squaredExteriorDistance(p), n + 1);
+      std::pair<double, Eigen::Index> second(
+          tree.Nodes_[node.Second_].Box_.squaredExteriorDistance(p),
+          node.Second_);
+      if (first.first > second.first) {
+        std::swap(first, second);
+      }
+      stack.push_back(second);
+      stack.push_back(first);
+      continue;
+    }
+    for (Eigen::Index i = node.First_; i < node.First_ + node.Count_; ++i) {
+      Eigen::Index f = tree.Facets_[i];
+      Eigen::Vector3d a = fV.row(fF(f, 0)).transpose();
+      Eigen::Vector3d b = fV.row(fF(f, 1)).transpose();
+      Eigen::Vector3d c = fV.row(fF(f, 2)).transpose();
+      Eigen::Vector3d lambda = closestPointBarycentric(p, a, b, c);
+      double distance =
+          (lambda[0] * a + lambda[1] * b + lambda[2] * c - p).squaredNorm();
+      if (distance < bestDistance) {
+        bestDistance = distance;
+        best = lambda[0] * fUV.row(fF(f, 0)).transpose() +
+               lambda[1] * fUV.row(fF(f, 1)).transpose() +
+               lambda[2] * fUV.row(fF(f, 2)).transpose();
+      }
+    }
+  }
+  return best;
+}
+
+Eigen::Matrix<double, Eigen::Dynamic, 3> BRep::pointsAtParams(
+    const FaceHandle &h,
+    const Eigen::Matrix<double, Eigen::Dynamic, 2> &uv) const {
+  Eigen::Matrix<double, Eigen::Dynamic, 3> result(uv.rows(), 3);
+  result.setConstant(std::numeric_limits<double>::quiet_NaN());
+  if (!hasFaceParams(h)) {
+    return result;
+  }
+  // Build the grid up front so the workers only read shared state
+  const auto &grid = faceParamGrid(h);
+  parallelFor(static_cast<std::size_t>(uv.rows()), [&](std::size_t i) {
+    auto p = pointAtParam(grid, h, uv.row(i).transpose());
+    if (p) {
+      result.row(i) = p->transpose();
+    }
+  });
+  return result;
+}
+
+Eigen::Matrix<double, Eigen::Dynamic, 3> BRep::pointsAtParams(
+    const EdgeHandle &h, const Eigen::VectorXd &t) const {
+  Eigen::Matrix<double, Eigen::Dynamic, 3> result(t.rows(), 3);
+  result.setConstant(std::numeric_limits<double>::quiet_NaN());
+  parallelFor(static_cast<std::size_t>(t.rows()), [&](std::size_t i) {
+    auto p = pointAtParam(h, t[i]);
+    if (p) {
+      result.row(i) = p->transpose();
+    }
+  });
+  return result;
+}
+
+Eigen::Matrix<double, Eigen::Dynamic, 2> BRep::paramsAtPoints(
+    const FaceHandle &h,
+    const Eigen::Matrix<double, Eigen::Dynamic, 3> &p) const {
+  Eigen::Matrix<double, Eigen::Dynamic, 2> result(p.rows(), 2);
+  result.setConstant(std::numeric_limits<double>::quiet_NaN());
+  if (!hasFaceParams(h)) {
+    return result;
+  }
+  // Build the tree up front so the workers only read shared state
+  const auto &tree = faceFacetTree(h);
+  parallelFor(static_cast<std::size_t>(p.rows()), [&](std::size_t i) {
+    auto uv = paramAtPoint(tree, h, p.row(i).transpose());
+    if (uv) {
+      result.row(i) = uv->transpose();
+    }
+  });
+  return result;
+}
+}  // namespace padt::brep
@@ -0,0 +1,283 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "brep.h"
+#include "brep.pb.h"
+#include "partition.h"
+#include "spatialOrder.h"
+
+namespace padt::brep {
+
+namespace {
+// A group of faces that is assigned to a partition as a unit
+struct PartitionItem {
+  std::uint64_t Code_ = 0;
+  std::size_t Weight_ = 0;
+  Eigen::Vector3d Center_;
+  std::vector<FaceHandle> Faces_;
+};
+}  // namespace
+
+std::vector<Partition> BRep::partition(std::size_t count,
+                                       PartitionLevel level) const {
+  std::vector<Partition> partitions(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    partitions[i].Index_ = i;
+    partitions[i].Count_ = count;
+  }
+  if (count == 0) {
+    return partitions;
+  }
+
+  // Gather the items to distribute.  Faces that belong to no body are always
+  // distributed on their own.
+  std::set<FaceHandle> sortedFaces(faces().begin(), faces().end());
+  std::vector<PartitionItem> items;
+  std::set<FaceHandle> grouped;
+  if (level == PartitionLevel::Body) {
+    std::set<BodyHandle> sortedBodies(bodies().begin(), bodies().end());
+    for (const auto &bH : sortedBodies) {
+      PartitionItem item;
+      for (const auto &fH : bodyFaces(bH)) {
+        if (Faces_.count(fH) > 0 && grouped.insert(fH).second) {
+          item.Faces_.push_back(fH);
+        }
+      }
+      if (item.Faces_.empty()) {
+        continue;
+      }
+      item.Center_ = boundingBox(bH).center();
+      items.push_back(std::move(item));
+    }
+  }
+  for (const auto &fH : sortedFaces) {
+    if (grouped.count(fH) == 0) {
+      PartitionItem item;
+      item.Faces_.push_back(fH);
+      item.Center_ = boundingBox(fH).center();
+      items.push_back(std::move(item));
+    }
+  }
+
+  // Order the items along a Morton curve through their centres
+  Eigen::AlignedBox3d bounds;
+  for (const auto &item : items) {
+    bounds.extend(item.Center_);
+  }
+  std::size_t totalWeight = 0;
+  for (auto &item : items) {
+    item.Code_ = mortonCode(item.Center_, bounds);
+    for (const auto &fH : item.Faces_) {
+      item.Weight_ += static_cast<std::size_t>(Faces_.at(fH).FacetSize_);
+    }
+    // Faces without facets still need an owner
+    item.Weight_ = std::max<std::size_t>(item.Weight_, 1);
+    totalWeight += item.Weight_;
+  }
+  std::stable_sort(
+      items.begin(), items.end(),
+      [](const auto &a, const auto &b) { return a.Code_ < b.Code_; });
+
+  // Cut the curve into runs of roughly equal triangle count
+  std::unordered_map<FaceHandle, std::size_t, HandleHash<FaceHandle>> faceOwner;
+  std::size_t current = 0;
+  std::size_t accumulated = 0;
+  for (const auto &item : items) {
+    for (const auto &fH : item.Faces_) {
+      faceOwner[fH] = current;
+      partitions[current].Faces_.push_back(fH);
+      partitions[current].Triangles_ +=
+          static_cast<std::size_t>(Faces_.at(fH).FacetSize_);
+    }
+    accumulated += item.Weight_;
+    while (current + 1 < count &&
+           accumulated * count >= totalWeight * (current + 1)) {
+      ++current;
+    }
+  }
+
+  // An edge is owned by the owner of its lowest numbered face.  Edges not
+  // used by any face go to the first partition.
+  std::unordered_map<EdgeHandle, std::size_t, HandleHash<EdgeHandle>> edgeOwner;
+  std::set<EdgeHandle> sortedEdges(edges().begin(), edges().end());
+  for (const auto &eH : sortedEdges) {
+    FaceHandle lowest;
+    for (const auto &fH : Edges_.at(eH).Faces_) {
+      if (faceOwner.count(fH) > 0 && (!lowest.isValid() || fH < lowest)) {
+        lowest = fH;
+      }
+    }
+    std::size_t owner = lowest.isValid() ? faceOwner.at(lowest) : 0;
+    edgeOwner[eH] = owner;
+    partitions[owner].Edges_.push_back(eH);
+  }
+
+  // Like unused edges, entities that no face or edge reaches go to the first
+  // partition.  The parents of an empty body follow it there on writing.
+  auto &first = partitions[0];
+  auto noneExist = [](const auto &handles, const auto &map) {
+    return std::none_of(handles.begin(), handles.end(),
+                        [&map](const auto &h) { return map.count(h) > 0; });
+  };
+  for (const auto &[vH, data] : Vertices_) {
+    if (noneExist(data.Edges_, Edges_)) {
+      first.LooseVertices_.push_back(vH);
+    }
+  }
+  for (const auto &[bH, data] : Bodies_) {
+    if (noneExist(data.Faces_, Faces_)) {
+      first.LooseBodies_.push_back(bH);
+    }
+  }
+  for (const auto &[pH, data] : Parts_) {
+    if (noneExist(data.Bodies_, Bodies_)) {
+      first.LooseParts_.push_back(pH);
+    }
+  }
+  for (const auto &[aH, data] : Assemblies_) {
+    if (noneExist(data.Parts_, Parts_)) {
+      first.LooseAssemblies_.push_back(aH);
+    }
+  }
+  std::sort(first.LooseVertices_.begin(), first.LooseVertices_.end());
+  std::sort(first.LooseBodies_.begin(), first.LooseBodies_.end());
+  std::sort(first.LooseParts_.begin(), first.LooseParts_.end());
+  std::sort(first.LooseAssemblies_.begin(), first.LooseAssemblies_.end());
+
+  // Ghosts are the faces across every boundary edge of an owned face, along
+  // with the edges those faces need to be loaded.
+  for (auto &p : partitions) {
+    std::set<FaceHandle> ghostFaces;
+    std::set<EdgeHandle> ghostEdges;
+    for (const auto &fH : p.Faces_) {
+      for (const auto &eH : faceEdges(fH)) {
+        if (edgeOwner.count(eH) == 0) {
+          continue;
+        }
+        for (const auto &nH : Edges_.at(eH).Faces_) {
+          if (faceOwner.count(nH) > 0 && faceOwner.at(nH) != p.Index_) {
+            ghostFaces.insert(nH);
+          }
+        }
+      }
+    }
+    auto addGhostEdges = [&](const FaceHandle &fH) {
+      for (const auto &eH : faceEdges(fH)) {
+        if (edgeOwner.count(eH) > 0 && edgeOwner.at(eH) != p.Index_) {
+          ghostEdges.insert(eH);
+        }
+      }
+    };
+    std::for_each(p.Faces_.begin(), p.Faces_.end(), addGhostEdges);
+    std::for_each(ghostFaces.begin(), ghostFaces.end(), addGhostEdges);
+    std::sort(p.Faces_.begin(), p.Faces_.end());
+    p.GhostFaces_.assign(ghostFaces.begin(), ghostFaces.end());
+    p.GhostEdges_.assign(ghostEdges.begin(), ghostEdges.end());
+  }
+  return partitions;
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream(
+    const Partition &p) const {
+  EntitySelection s;
+  selectPartition(p, s);
+  return entityStream(s);
+}
+
+bool BRep::writeBRepToFile(const std::string &fileName,
+                           const Partition &p) const {
+  EntitySelection s;
+  selectPartition(p, s);
+  return writeBRepToFile(fileName, s);
+}
+
+void BRep::selectPartition(const Partition &p, EntitySelection &s) const {
+  s.Partition_ = &p;
+  s.Faces_.insert(p.Faces_.begin(), p.Faces_.end());
+  s.Faces_.insert(p.GhostFaces_.begin(), p.GhostFaces_.end());
+  s.Edges_.insert(p.Edges_.begin(), p.Edges_.end());
+  s.Edges_.insert(p.GhostEdges_.begin(), p.GhostEdges_.end());
+  for (const auto &eH : s.Edges_) {
+    for (const auto &vH : {startVertex(eH), endVertex(eH)}) {
+      if (Vertices_.count(vH) > 0) {
+        s.Vertices_.insert(vH);
+      }
+    }
+  }
+  s.Vertices_.insert(p.LooseVertices_.begin(), p.LooseVertices_.end());
+  s.Bodies_.insert(p.LooseBodies_.begin(), p.LooseBodies_.end());
+  s.Parts_.insert(p.LooseParts_.begin(), p.LooseParts_.end());
+  s.Assemblies_.insert(p.LooseAssemblies_.begin(), p.LooseAssemblies_.end());
+  // Keep the chain of parents above the selected faces
+  for (const auto &fH : s.Faces_) {
+    const auto &faceBodies = Faces_.at(fH).Bodies_;
+    s.Bodies_.insert(faceBodies.begin(), faceBodies.end());
+  }
+  selectAbove(s);
+}
+
+bool BRep::addPartition(const padt::brep::proto::Partition &partition) {
+  PartitionInfo_ = Partition();
+  PartitionInfo_.Index_ = static_cast<std::size_t>(partition.index());
+  PartitionInfo_.Count_ = static_cast<std::size_t>(partition.count());
+  std::transform(partition.ghost_faces().begin(),
+                 partition.ghost_faces().end(),
+                 std::back_inserter(PartitionInfo_.GhostFaces_),
+                 [](const auto &fId) -> FaceHandle { return FaceHandle(fId); });
+  std::transform(partition.ghost_edges().begin(),
+                 partition.ghost_edges().end(),
+                 std::back_inserter(PartitionInfo_.GhostEdges_),
+                 [](const auto &eId) -> EdgeHandle { return EdgeHandle(eId); });
+  std::sort(PartitionInfo_.GhostFaces_.begin(),
+            PartitionInfo_.GhostFaces_.end());
+  std::sort(PartitionInfo_.GhostEdges_.begin(),
+            PartitionInfo_.GhostEdges_.end());
+  return true;
+}
+
+void BRep::buildPartitionInfo() {
+  if (PartitionInfo_.Count_ == 0) {
+    return;
+  }
+  // Everything in a chunk that is not a ghost is owned by it
+  PartitionInfo_.Faces_.clear();
+  PartitionInfo_.Edges_.clear();
+  PartitionInfo_.Triangles_ = 0;
+  for (const auto &[fH, fData] : Faces_) {
+    if (!PartitionInfo_.isGhost(fH)) {
+      PartitionInfo_.Faces_.push_back(fH);
+      PartitionInfo_.Triangles_ += static_cast<std::size_t>(fData.FacetSize_);
+    }
+  }
+  for (const auto &[eH, eData] : Edges_) {
+    if (!PartitionInfo_.isGhost(eH)) {
+      PartitionInfo_.Edges_.push_back(eH);
+    }
+  }
+  std::sort(PartitionInfo_.Faces_.begin(), PartitionInfo_.Faces_.end());
+  std::sort(PartitionInfo_.Edges_.begin(), PartitionInfo_.Edges_.end());
+}
+}  // namespace padt::brep
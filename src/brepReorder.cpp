@@ -0,0 +1,326 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "brep.h"
+#include "parallel.h"
+#include "spatialOrder.h"
+
+namespace padt::brep {
+
+namespace {
+// Tom Forsyth's linear-speed vertex cache optimisation, see
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+constexpr int CacheSize = 32;
+constexpr double CacheDecayPower = 1.5;
+constexpr double LastTriScore = 0.75;
+constexpr double ValenceBoostScale = 2.0;
+constexpr double ValenceBoostPower = 0.5;
+
+double vertexScore(int cachePosition, int remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0;
+  }
+  double score = 0.0;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      score = LastTriScore;
+    } else {
+      double scaler = 1.0 / (CacheSize - 3);
+      score = std::pow(1.0 - (cachePosition - 3) * scaler, CacheDecayPower);
+    }
+  }
+  score += ValenceBoostScale * std::pow(static_cast<double>(remainingTriangles),
+                                        -ValenceBoostPower);
+  return score;
+}
+
+// Returns the facets of F in an order that reuses recently referenced
+// vertices.  Indices in F must lie in [0, numPoints).
+template <typename FacetsT>
+std::vector<Eigen::Index> vertexCacheOrder(const FacetsT &F,
+                                           Eigen::Index numPoints) {
+  const Eigen::Index numFacets = F.rows();
+  std::vector<Eigen::Index> order;
+  order.reserve(numFacets);
+
+  // Facets using each point in compressed rows
+  std::vector<Eigen::Index> pointStart(numPoints + 1, 0);
+  for (Eigen::Index f = 0; f < numFacets; ++f) {
+    for (int k = 0; k < 3; ++k) {
+      pointStart[F(f, k) + 1]++;
+    }
+  }
+  for (Eigen::Index v = 0; v < numPoints; ++v) {
+    pointStart[v + 1] += pointStart[v];
+  }
+  std::vector<Eigen::Index> pointFacets(pointStart.back());
+  std::vector<Eigen::Index> fill(pointStart.begin(), pointStart.end() - 1);
+  for (Eigen::Index f = 0; f < numFacets; ++f) {
+    for (int k = 0; k < 3; ++k) {
+      pointFacets[fill[F(f, k)]++] = f;
+    }
+  }
+
+  std::vector<int> remaining(numPoints);
+  std::vector<int> cachePosition(numPoints, -1);
+  std::vector<double> pointScore(numPoints);
+  for (Eigen::Index v = 0; v < numPoints; ++v) {
+    remaining[v] = static_cast<int>(pointStart[v + 1] - pointStart[v]);
+    pointScore[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<double> facetScore(numFacets);
+  std::vector<char> emitted(numFacets, 0);
+  for (Eigen::Index f = 0; f < numFacets; ++f) {
+    facetScore[f] = pointScore[F(f, 0)] + pointScore[F(f, 1)] +
+                    pointScore[F(f, 2)];
+  }
+
+  std::vector<Eigen::Index> cache;
+  Eigen::Index scan = 0;
+  Eigen::Index best = -1;
+  while (static_cast<Eigen::Index>(order.size()) < numFacets) {
+    if (best < 0) {
+      // Nothing usable in the cache, take the best remaining facet
+      double bestScore = -1.0;
+      for (Eigen::Index f = scan; f < numFacets; ++f) {
+        if (!emitted[f] && facetScore[f] > bestScore) {
+          bestScore = facetScore[f];
+          best = f;
+        }
+      }
+      while (scan < numFacets && emitted[scan]) {
+        ++scan;
+      }
+    }
+    order.push_back(best);
+    emitted[best] = 1;
+
+    // Move the facet's points to the front of the cache
+    std::vector<Eigen::Index> newCache;
+    newCache.reserve(cache.size() + 3);
+    for (int k = 0; k < 3; ++k) {
+      Eigen::Index v = F(best, k);
+      remaining[v]--;
+      newCache.push_back(v);
+    }
+    for (auto v : cache) {
+      if (v != F(best, 0) && v != F(best, 1) && v != F(best, 2)) {
+        newCache.push_back(v);
+      }
+    }
+    for (std::size_t i = CacheSize; i < newCache.size(); ++i) {
+      cachePosition[newCache[i]] = -1;
+      pointScore[newCache[i]] = vertexScore(-1, remaining[newCache[i]]);
+    }
+    if (newCache.size() > static_cast<std::size_t>(CacheSize)) {
+      newCache.resize(CacheSize);
+    }
+    cache.swap(newCache);
+
+    // Rescore the cached points and their facets, picking the next facet
+    for (std::size_t i = 0; i < cache.size(); ++i) {
+      cachePosition[cache[i]] = static_cast<int>(i);
+      pointScore[cache[i]] =
+          vertexScore(static_cast<int>(i), remaining[cache[i]]);
+    }
+    best = -1;
+    double bestScore = -1.0;
+    for (auto v : cache) {
+      for (Eigen::Index i = pointStart[v]; i < pointStart[v + 1]; ++i) {
+        Eigen::Index f = pointFacets[i];
+        if (emitted[f]) {
+          continue;
+        }
+        facetScore[f] = pointScore[F(f, 0)] + pointScore[F(f, 1)] +
+                        pointScore[F(f, 2)];
+        if (facetScore[f] > bestScore) {
+          bestScore = facetScore[f];
+          best = f;
+        }
+      }
+    }
+  }
+  return order;
+}
+
+template <typename HandleT, typename CentreF>
+std::vector<HandleT> mortonOrder(std::vector<HandleT> handles,
+                                 CentreF centre) {
+  std::vector<Eigen::Vector3d> centres;
+  Eigen::AlignedBox3d bounds;
+  for (const auto &h : handles) {
+    centres.push_back(centre(h));
+    bounds.extend(centres.back());
+  }
+  std::vector<std::pair<std::uint64_t, HandleT>> keyed;
+  for (std::size_t i = 0; i < handles.size(); ++i) {
+    keyed.emplace_back(mortonCode(centres[i], bounds), handles[i]);
+  }
+  std::sort(keyed.begin(), keyed.end());
+  for (std::size_t i = 0; i < keyed.size(); ++i) {
+    handles[i] = keyed[i].second;
+  }
+  return handles;
+}
+}  // namespace
+
+void BRep::reorderGeometry() {
+  // Lay faces, then edges, then vertices along a Morton curve through their
+  // bounding box centres
+  std::vector<FaceHandle> faceOrder =
+      mortonOrder(std::vector<FaceHandle>(faces().begin(), faces().end()),
+                  [this](const auto &h) { return boundingBox(h).center(); });
+  std::vector<EdgeHandle> edgeOrder =
+      mortonOrder(std::vector<EdgeHandle>(edges().begin(), edges().end()),
+                  [this](const auto &h) { return boundingBox(h).center(); });
+  std::vector<VertexHandle> vertexOrder;
+  for (const auto &[vH, vData] : Vertices_) {
+    vertexOrder.push_back(vH);
+  }
+  vertexOrder = mortonOrder(vertexOrder, [this](const auto &h) {
+    return Eigen::Vector3d(V_.row(Vertices_.at(h).PointIndex_).transpose());
+  });
+
+  // New ranges, assigned in curve order
+  std::vector<FaceData> newFaces;
+  Eigen::Index points = 0;
+  Eigen::Index facets = 0;
+  Eigen::Index faceParams = 0;
+  for (const auto &fH : faceOrder) {
+    FaceData data = Faces_.at(fH);
+    data.PointStart_ = points;
+    data.FacetStart_ = facets;
+    data.ParamStart_ = faceParams;
+    points += data.PointSize_;
+    facets += data.FacetSize_;
+    faceParams += data.ParamSize_;
+    newFaces.push_back(std::move(data));
+  }
+  std::vector<EdgeData> newEdges;
+  Eigen::Index edgeParams = 0;
+  for (const auto &eH : edgeOrder) {
+    EdgeData data = Edges_.at(eH);
+    data.PointStart_ = points;
+    data.ParamStart_ = edgeParams;
+    points += data.PointSize_;
+    edgeParams += data.ParamSize_;
+    newEdges.push_back(std::move(data));
+  }
+
+  Eigen::Matrix<double, Eigen::Dynamic, 3> newV(points + vertexOrder.size(),
+                                                3);
+  Eigen::Matrix<int, Eigen::Dynamic, 3> newF(facets, 3);
+  Eigen::Matrix<double, Eigen::Dynamic, 2> newFaceParams(faceParams, 2);
+  Eigen::VectorXd newEdgeParams(edgeParams);
+
+  // Faces are independent, so reorder each one's facets and points in
+  // parallel.  Points are renumbered in order of first use by the facets.
+  parallelFor(faceOrder.size(), [&](std::size_t i) {
+    const auto &oldData = Faces_.at(faceOrder[i]);
+    const auto &newData = newFaces[i];
+    auto oldF = F_.block(oldData.FacetStart_, 0, oldData.FacetSize_, 3);
+    // Malformed connectivity is copied over as it is
+    bool renumber = oldF.size() == 0 || (oldF.minCoeff() >= 0 &&
+                                         oldF.maxCoeff() < oldData.PointSize_);
+    std::vector<Eigen::Index> facetOrder;
+    if (renumber) {
+      facetOrder = vertexCacheOrder(oldF, oldData.PointSize_);
+    } else {
+      for (Eigen::Index f = 0; f < oldData.FacetSize_; ++f) {
+        facetOrder.push_back(f);
+      }
+    }
+    std::vector<Eigen::Index> pointMap(oldData.PointSize_, -1);
+    std::vector<Eigen::Index> pointOrder;
+    pointOrder.reserve(oldData.PointSize_);
+    for (std::size_t f = 0; f < facetOrder.size(); ++f) {
+      for (int k = 0; k < 3; ++k) {
+        int v = oldF(facetOrder[f], k);
+        if (renumber && pointMap[v] < 0) {
+          pointMap[v] = static_cast<Eigen::Index>(pointOrder.size());
+          pointOrder.push_back(v);
+        }
+        newF(newData.FacetStart_ + f, k) =
+            renumber ? static_cast<int>(pointMap[v]) : v;
+      }
+    }
+    for (Eigen::Index v = 0; v < oldData.PointSize_; ++v) {
+      if (pointMap[v] < 0) {
+        pointMap[v] = static_cast<Eigen::Index>(pointOrder.size());
+        pointOrder.push_back(v);
+      }
+    }
+    for (std::size_t v = 0; v < pointOrder.size(); ++v) {
+      newV.row(newData.PointStart_ + v) =
+          V_.row(oldData.PointStart_ + pointOrder[v]);
+    }
+    // Parameters pair with points when there is one per point
+    bool paired = oldData.ParamSize_ == oldData.PointSize_;
+    for (Eigen::Index p = 0; p < oldData.ParamSize_; ++p) {
+      newFaceParams.row(newData.ParamStart_ + p) = FaceParams_.row(
+          oldData.ParamStart_ + (paired ? pointOrder[p] : p));
+    }
+  });
+
+  for (std::size_t i = 0; i < edgeOrder.size(); ++i) {
+    const auto &oldData = Edges_.at(edgeOrder[i]);
+    const auto &newData = newEdges[i];
+    newV.block(newData.PointStart_, 0, newData.PointSize_, 3) =
+        V_.block(oldData.PointStart_, 0, oldData.PointSize_, 3);
+    newEdgeParams.segment(newData.ParamStart_, newData.ParamSize_) =
+        EdgeParams_.segment(oldData.ParamStart_, oldData.ParamSize_);
+  }
+  for (std::size_t i = 0; i < vertexOrder.size(); ++i) {
+    auto &data = Vertices_.at(vertexOrder[i]);
+    newV.row(points + i) = V_.row(data.PointIndex_);
+    data.PointIndex_ = points + i;
+  }
+
+  for (std::size_t i = 0; i < faceOrder.size(); ++i) {
+    Faces_.at(faceOrder[i]) = std::move(newFaces[i]);
+  }
+  for (std::size_t i = 0; i < edgeOrder.size(); ++i) {
+    Edges_.at(edgeOrder[i]) = std::move(newEdges[i]);
+  }
+  V_.swap(newV);
+  F_.swap(newF);
+  FaceParams_.swap(newFaceParams);
+  EdgeParams_.swap(newEdgeParams);
+  PointRows_ = V_.rows();
+  FacetRows_ = F_.rows();
+  FaceParamRows_ = FaceParams_.rows();
+  EdgeParamRows_ = EdgeParams_.rows();
+
+  // Only live geometry was copied over
+  GarbagePoints_ = 0;
+  GarbageFacets_ = 0;
+  GarbageFaceParams_ = 0;
+  GarbageEdgeParams_ = 0;
+
+  // Bounding boxes are unchanged but the search structures index facets
+  FaceParamGridCache_.clear();
+  FaceFacetTreeCache_.clear();
+}
+}  // namespace padt::brep
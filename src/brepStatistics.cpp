@@ -0,0 +1,120 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <cstddef>
+#include <vector>
+#include "brep.h"
+#include "instrumentation.h"
+
+namespace padt::brep {
+
+namespace {
+template <typename T>
+std::size_t vectorBytes(const std::vector<T> &v) {
+  return v.capacity() * sizeof(T);
+}
+
+template <typename MatrixT>
+std::size_t matrixBytes(const MatrixT &m) {
+  return static_cast<std::size_t>(m.size()) * sizeof(typename MatrixT::Scalar);
+}
+
+// Estimate the heap held by an unordered_map: the bucket array, one node per
+// element (value, next pointer and cached hash) and whatever the values own.
+template <typename MapT, typename OwnedBytesF>
+std::size_t mapBytes(const MapT &m, OwnedBytesF ownedBytes) {
+  const std::size_t nodeBytes = sizeof(typename MapT::value_type) +
+                                sizeof(void *) + sizeof(std::size_t);
+  std::size_t bytes = m.bucket_count() * sizeof(void *) + m.size() * nodeBytes;
+  for (const auto &[h, data] : m) {
+    bytes += ownedBytes(data);
+  }
+  return bytes;
+}
+
+template <typename MapT>
+std::size_t mapBytes(const MapT &m) {
+  return mapBytes(m, [](const auto &) -> std::size_t { return 0; });
+}
+}  // namespace
+
+MemoryUsage BRep::memoryUsage() const {
+  MemoryUsage usage;
+  usage.Points_ = matrixBytes(V_);
+  usage.Facets_ = matrixBytes(F_);
+  usage.FaceParams_ = matrixBytes(FaceParams_);
+  usage.EdgeParams_ = matrixBytes(EdgeParams_);
+
+  usage.Assemblies_ = mapBytes(Assemblies_, [](const auto &d) {
+    return vectorBytes(d.Parts_);
+  });
+  usage.Parts_ = mapBytes(Parts_, [](const auto &d) {
+    return vectorBytes(d.Bodies_) + vectorBytes(d.Assemblies_);
+  });
+  usage.Bodies_ = mapBytes(Bodies_, [](const auto &d) {
+    return vectorBytes(d.Faces_) + vectorBytes(d.Shells_) +
+           vectorBytes(d.Edges_) + vectorBytes(d.Vertices_) +
+           vectorBytes(d.Parts_);
+  });
+  usage.Faces_ = mapBytes(Faces_, [](const auto &d) {
+    return vectorBytes(d.Edges_) + vectorBytes(d.Loops_) +
+           vectorBytes(d.Bodies_);
+  });
+  usage.Edges_ =
+      mapBytes(Edges_, [](const auto &d) { return vectorBytes(d.Faces_); });
+  usage.Vertices_ =
+      mapBytes(Vertices_, [](const auto &d) { return vectorBytes(d.Edges_); });
+  usage.Loops_ =
+      mapBytes(Loops_, [](const auto &d) { return vectorBytes(d.Edges_); });
+  usage.Shells_ =
+      mapBytes(Shells_, [](const auto &d) { return vectorBytes(d.Faces_); });
+
+  usage.AssemblyBBoxCache_ = mapBytes(AssemblyBBoxCache_);
+  usage.PartBBoxCache_ = mapBytes(PartBBoxCache_);
+  usage.BodyBBoxCache_ = mapBytes(BodyBBoxCache_);
+  usage.FaceBBoxCache_ = mapBytes(FaceBBoxCache_);
+  usage.EdgeBBoxCache_ = mapBytes(EdgeBBoxCache_);
+
+  usage.FaceParamGridCache_ = mapBytes(FaceParamGridCache_, [](const auto &d) {
+    return vectorBytes(d.CellStart_) + vectorBytes(d.CellFacets_);
+  });
+  usage.FaceFacetTreeCache_ = mapBytes(FaceFacetTreeCache_, [](const auto &d) {
+    return vectorBytes(d.Nodes_) + vectorBytes(d.Facets_);
+  });
+  return usage;
+}
+
+BRepStatistics BRep::statistics() const {
+  BRepStatistics stats;
+#ifdef PADT_BREP_INSTRUMENTATION
+  stats.InstrumentationEnabled_ = true;
+#endif
+  stats.Memory_ = memoryUsage();
+  stats.Timings_ = Timings_;
+  stats.BBoxCache_ = BBoxCacheCounters_;
+  return stats;
+}
+
+void BRep::resetStatistics() {
+  Timings_ = PhaseTimings();
+  BBoxCacheCounters_ = BoundingBoxCacheCounters();
+}
+}  // namespace padt::brep
@@ -0,0 +1,415 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <variant>
+#include <vector>
+#include "brep.h"
+#include "brep.pb.h"
+#include "parallel.h"
+#include "partition.h"
+#include "utility.h"
+
+namespace padt::brep {
+
+namespace {
+// Number of entities encoded in parallel before the batch is flushed to disk.
+// Bounds the memory held by encoded records when writing large models.
+constexpr std::size_t WriteBatchSize = 4096;
+
+typedef std::variant<AssemblyHandle, PartHandle, BodyHandle, FaceHandle,
+                     EdgeHandle, VertexHandle>
+    AnyHandle;
+
+// Flatten a selection into a single handle list in stream order: assemblies,
+// parts, bodies, faces, edges then vertices.
+template <typename SelectionT>
+std::vector<AnyHandle> flattenSelection(const SelectionT &s) {
+  std::vector<AnyHandle> handles;
+  handles.insert(handles.end(), s.Assemblies_.begin(), s.Assemblies_.end());
+  handles.insert(handles.end(), s.Parts_.begin(), s.Parts_.end());
+  handles.insert(handles.end(), s.Bodies_.begin(), s.Bodies_.end());
+  handles.insert(handles.end(), s.Faces_.begin(), s.Faces_.end());
+  handles.insert(handles.end(), s.Edges_.begin(), s.Edges_.end());
+  handles.insert(handles.end(), s.Vertices_.begin(), s.Vertices_.end());
+  return handles;
+}
+
+template <typename SetT, typename HandleT>
+bool selected(const SetT &s, const HandleT &h) {
+  return s.count(h) > 0;
+}
+
+// The leading record of a partition chunk
+padt::brep::proto::BRepEntity makePartitionEntity(const Partition &p) {
+  padt::brep::proto::BRepEntity entity;
+  auto *partition = entity.mutable_partition();
+  partition->set_index(static_cast<std::int64_t>(p.Index_));
+  partition->set_count(static_cast<std::int64_t>(p.Count_));
+  for (const auto &fH : p.GhostFaces_) {
+    partition->add_ghost_faces(fH.idx());
+  }
+  for (const auto &eH : p.GhostEdges_) {
+    partition->add_ghost_edges(eH.idx());
+  }
+  return entity;
+}
+}  // namespace
+
+bool BRep::writeBRepToFile(const std::string &fileName) const {
+  return writeBRepToFile(fileName, selectAll());
+}
+
+bool BRep::writeBRepToFile(const std::string &fileName,
+                           const AssemblyHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  return writeBRepToFile(fileName, s);
+}
+
+bool BRep::writeBRepToFile(const std::string &fileName,
+                           const PartHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  selectAbove(s);
+  return writeBRepToFile(fileName, s);
+}
+
+bool BRep::writeBRepToFile(const std::string &fileName,
+                           const BodyHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  selectAbove(s);
+  return writeBRepToFile(fileName, s);
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream() const {
+  return entityStream(selectAll());
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream(
+    const AssemblyHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  return entityStream(s);
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream(
+    const PartHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  selectAbove(s);
+  return entityStream(s);
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream(
+    const BodyHandle &h) const {
+  EntitySelection s;
+  selectBelow(h, s);
+  selectAbove(s);
+  return entityStream(s);
+}
+
+BRep::EntitySelection BRep::selectAll() const {
+  EntitySelection s;
+  for (const auto &[h, data] : Assemblies_) s.Assemblies_.insert(h);
+  for (const auto &[h, data] : Parts_) s.Parts_.insert(h);
+  for (const auto &[h, data] : Bodies_) s.Bodies_.insert(h);
+  for (const auto &[h, data] : Faces_) s.Faces_.insert(h);
+  for (const auto &[h, data] : Edges_) s.Edges_.insert(h);
+  for (const auto &[h, data] : Vertices_) s.Vertices_.insert(h);
+  return s;
+}
+
+void BRep::selectBelow(const AssemblyHandle &h, EntitySelection &s) const {
+  if (Assemblies_.count(h) == 0) {
+    return;
+  }
+  s.Assemblies_.insert(h);
+  for (const auto &pH : Assemblies_.at(h).Parts_) {
+    selectBelow(pH, s);
+  }
+}
+
+void BRep::selectBelow(const PartHandle &h, EntitySelection &s) const {
+  if (Parts_.count(h) == 0) {
+    return;
+  }
+  s.Parts_.insert(h);
+  for (const auto &bH : Parts_.at(h).Bodies_) {
+    selectBelow(bH, s);
+  }
+}
+
+void BRep::selectBelow(const BodyHandle &h, EntitySelection &s) const {
+  if (Bodies_.count(h) == 0) {
+    return;
+  }
+  s.Bodies_.insert(h);
+  const auto &bodyData = Bodies_.at(h);
+  for (const auto &fH : bodyData.Faces_) {
+    if (Faces_.count(fH) > 0) {
+      s.Faces_.insert(fH);
+    }
+  }
+  for (const auto &eH : bodyData.Edges_) {
+    if (Edges_.count(eH) > 0) {
+      s.Edges_.insert(eH);
+    }
+  }
+  for (const auto &vH : bodyData.Vertices_) {
+    if (Vertices_.count(vH) > 0) {
+      s.Vertices_.insert(vH);
+    }
+  }
+}
+
+void BRep::selectAbove(EntitySelection &s) const {
+  for (const auto &[pH, partData] : Parts_) {
+    for (const auto &bH : partData.Bodies_) {
+      if (s.Bodies_.count(bH) > 0) {
+        s.Parts_.insert(pH);
+        break;
+      }
+    }
+  }
+  for (const auto &[aH, assemblyData] : Assemblies_) {
+    for (const auto &pH : assemblyData.Parts_) {
+      if (s.Parts_.count(pH) > 0) {
+        s.Assemblies_.insert(aH);
+        break;
+      }
+    }
+  }
+}
+
+std::vector<padt::brep::proto::BRepEntity> BRep::entityStream(
+    const EntitySelection &s) const {
+  std::vector<AnyHandle> handles = flattenSelection(s);
+
+  std::size_t offset = s.Partition_ != nullptr ? 1 : 0;
+  std::vector<padt::brep::proto::BRepEntity> entities(offset + handles.size());
+  if (s.Partition_ != nullptr) {
+    entities[0] = makePartitionEntity(*s.Partition_);
+  }
+  parallelFor(handles.size(), [&](std::size_t i) {
+    entities[offset + i] = std::visit(
+        [this, &s](const auto &h) { return makeEntity(h, s); }, handles[i]);
+  });
+  return entities;
+}
+
+bool BRep::writeBRepToFile(const std::string &fileName,
+                           const EntitySelection &s) const {
+  std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  std::vector<AnyHandle> handles = flattenSelection(s);
+  if (s.Partition_ != nullptr) {
+    std::string record;
+    google::protobuf::io::StringOutputStream pbout(&record);
+    if (!padt::pbio::writeDelimitedTo(makePartitionEntity(*s.Partition_),
+                                      &pbout)) {
+      return false;
+    }
+    out.write(record.data(), static_cast<std::streamsize>(record.size()));
+  }
+
+  // Encode each batch of entities in parallel into delimited records, then
+  // write the records out in order.
+  std::vector<std::string> records;
+  for (std::size_t first = 0; first < handles.size();
+       first += WriteBatchSize) {
+    std::size_t count = std::min(WriteBatchSize, handles.size() - first);
+    records.assign(count, std::string());
+    std::vector<char> encoded(count, 0);
+    parallelFor(count, [&](std::size_t i) {
+      auto entity =
+          std::visit([this, &s](const auto &h) { return makeEntity(h, s); },
+                     handles[first + i]);
+      google::protobuf::io::StringOutputStream pbout(&records[i]);
+      encoded[i] = padt::pbio::writeDelimitedTo(entity, &pbout);
+    });
+    if (std::find(encoded.begin(), encoded.end(), 0) != encoded.end()) {
+      return false;
+    }
+    for (const auto &r : records) {
+      out.write(r.data(), static_cast<std::streamsize>(r.size()));
+    }
+    if (!out.good()) {
+      return false;
+    }
+  }
+  if (s.Compression_ != nullptr) {
+    for (const auto &chunk : makeGeometryChunks(s)) {
+      std::string record;
+      google::protobuf::io::StringOutputStream pbout(&record);
+      if (!padt::pbio::writeDelimitedTo(chunk, &pbout)) {
+        return false;
+      }
+      out.write(record.data(), static_cast<std::streamsize>(record.size()));
+    }
+  }
+  out.flush();
+  return out.good();
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const AssemblyHandle &h, const EntitySelection &s) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *assembly = entity.mutable_assembly();
+  assembly->set_id(h.idx());
+  for (const auto &pH : Assemblies_.at(h).Parts_) {
+    if (selected(s.Parts_, pH)) {
+      assembly->add_parts(pH.idx());
+    }
+  }
+  return entity;
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const PartHandle &h, const EntitySelection &s) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *part = entity.mutable_part();
+  part->set_id(h.idx());
+  for (const auto &bH : Parts_.at(h).Bodies_) {
+    if (selected(s.Bodies_, bH)) {
+      part->add_bodies(bH.idx());
+    }
+  }
+  return entity;
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const BodyHandle &h, const EntitySelection &s) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *body = entity.mutable_body();
+  const auto &bodyData = Bodies_.at(h);
+  body->set_id(h.idx());
+  for (const auto &fH : bodyData.Faces_) {
+    if (selected(s.Faces_, fH)) {
+      body->add_faces(fH.idx());
+    }
+  }
+  for (const auto &sH : bodyData.Shells_) {
+    auto *shell = body->add_shells();
+    shell->set_id(sH.idx());
+    for (const auto &fH : Shells_.at(sH).Faces_) {
+      if (selected(s.Faces_, fH)) {
+        shell->add_faces(fH.idx());
+      }
+    }
+  }
+  return entity;
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const FaceHandle &h, const EntitySelection &s) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *face = entity.mutable_face();
+  const auto &faceData = Faces_.at(h);
+  face->set_id(h.idx());
+  auto *surface = face->mutable_surface();
+  for (const auto &eH : faceData.Edges_) {
+    face->add_edges(eH.idx());
+  }
+  for (const auto &lH : faceData.Loops_) {
+    auto *loop = face->add_loops();
+    loop->set_id(lH.idx());
+    for (const auto &eH : Loops_.at(lH).Edges_) {
+      loop->add_edges(eH.idx());
+    }
+  }
+  if (s.Compression_ != nullptr) {
+    return entity;
+  }
+  surface->mutable_points()->Reserve(static_cast<int>(faceData.PointSize_));
+  for (Eigen::Index row = faceData.PointStart_;
+       row < faceData.PointStart_ + faceData.PointSize_; ++row) {
+    auto *p = surface->add_points();
+    p->set_x(V_(row, 0));
+    p->set_y(V_(row, 1));
+    p->set_z(V_(row, 2));
+  }
+  surface->mutable_triangles()->Reserve(static_cast<int>(faceData.FacetSize_));
+  for (Eigen::Index row = faceData.FacetStart_;
+       row < faceData.FacetStart_ + faceData.FacetSize_; ++row) {
+    auto *t = surface->add_triangles();
+    t->set_i(F_(row, 0));
+    t->set_j(F_(row, 1));
+    t->set_k(F_(row, 2));
+  }
+  surface->mutable_parameters()->Reserve(static_cast<int>(faceData.ParamSize_));
+  for (Eigen::Index row = faceData.ParamStart_;
+       row < faceData.ParamStart_ + faceData.ParamSize_; ++row) {
+    auto *p = surface->add_parameters();
+    p->set_u(FaceParams_(row, 0));
+    p->set_v(FaceParams_(row, 1));
+  }
+  return entity;
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const EdgeHandle &h, const EntitySelection &s) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *edge = entity.mutable_edge();
+  const auto &edgeData = Edges_.at(h);
+  edge->set_id(h.idx());
+  edge->set_start(edgeData.startVertex_.idx());
+  edge->set_end(edgeData.endVertex_.idx());
+  auto *curve = edge->mutable_curve();
+  if (s.Compression_ != nullptr) {
+    return entity;
+  }
+  curve->mutable_points()->Reserve(static_cast<int>(edgeData.PointSize_));
+  for (Eigen::Index row = edgeData.PointStart_;
+       row < edgeData.PointStart_ + edgeData.PointSize_; ++row) {
+    auto *p = curve->add_points();
+    p->set_x(V_(row, 0));
+    p->set_y(V_(row, 1));
+    p->set_z(V_(row, 2));
+  }
+  curve->mutable_parameters()->Reserve(static_cast<int>(edgeData.ParamSize_));
+  for (Eigen::Index row = edgeData.ParamStart_;
+       row < edgeData.ParamStart_ + edgeData.ParamSize_; ++row) {
+    curve->add_parameters(EdgeParams_(row));
+  }
+  return entity;
+}
+
+padt::brep::proto::BRepEntity BRep::makeEntity(
+    const VertexHandle &h, const EntitySelection &) const {
+  padt::brep::proto::BRepEntity entity;
+  auto *vertex = entity.mutable_vertex();
+  const auto &vertexData = Vertices_.at(h);
+  vertex->set_id(h.idx());
+  auto *p = vertex->mutable_point();
+  p->set_x(V_(vertexData.PointIndex_, 0));
+  p->set_y(V_(vertexData.PointIndex_, 1));
+  p->set_z(V_(vertexData.PointIndex_, 2));
+  return entity;
+}
+}  // namespace padt::brep
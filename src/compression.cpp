@@ -0,0 +1,179 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include "compression.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace padt::brep {
+
+namespace {
+constexpr std::size_t MinMatch = 4;
+constexpr std::size_t MaxOffset = 0xffff;
+constexpr int HashBits = 16;
+
+std::uint32_t read32(const std::uint8_t *p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint32_t hash4(const std::uint8_t *p) {
+  return (read32(p) * 2654435761u) >> (32 - HashBits);
+}
+
+// Lengths of 15 and over continue in following bytes, 255 at a time
+void putLength(std::string &out, std::size_t length) {
+  while (length >= 255) {
+    out.push_back(static_cast<char>(255));
+    length -= 255;
+  }
+  out.push_back(static_cast<char>(length));
+}
+
+bool getLength(const std::uint8_t *&p, const std::uint8_t *end,
+               std::size_t &length) {
+  std::uint8_t byte;
+  do {
+    if (p >= end) {
+      return false;
+    }
+    byte = *p++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+void putSequence(std::string &out, const std::uint8_t *literals,
+                 std::size_t literalLength, std::size_t offset,
+                 std::size_t matchLength) {
+  std::size_t extra = matchLength > 0 ? matchLength - MinMatch : 0;
+  std::size_t token = (std::min<std::size_t>(literalLength, 15) << 4) |
+                      std::min<std::size_t>(extra, 15);
+  out.push_back(static_cast<char>(token));
+  if (literalLength >= 15) {
+    putLength(out, literalLength - 15);
+  }
+  out.append(reinterpret_cast<const char *>(literals), literalLength);
+  if (matchLength == 0) {
+    return;
+  }
+  out.push_back(static_cast<char>(offset & 0xff));
+  out.push_back(static_cast<char>(offset >> 8));
+  if (extra >= 15) {
+    putLength(out, extra - 15);
+  }
+}
+}  // namespace
+
+std::string lzCompress(const std::string &input) {
+  std::string out;
+  out.reserve(input.size() / 2 + 16);
+  const auto *begin = reinterpret_cast<const std::uint8_t *>(input.data());
+  const auto *end = begin + input.size();
+  const auto *literals = begin;
+  const auto *p = begin;
+  std::vector<std::uint32_t> table(std::size_t(1) << HashBits, 0);
+  // Positions are stored plus one so that zero marks an empty slot
+  while (end - p >= static_cast<std::ptrdiff_t>(MinMatch)) {
+    std::uint32_t h = hash4(p);
+    std::uint32_t candidate = table[h];
+    table[h] = static_cast<std::uint32_t>(p - begin) + 1;
+    if (candidate == 0) {
+      ++p;
+      continue;
+    }
+    const auto *match = begin + candidate - 1;
+    if (static_cast<std::size_t>(p - match) > MaxOffset ||
+        read32(match) != read32(p)) {
+      ++p;
+      continue;
+    }
+    std::size_t length = MinMatch;
+    while (p + length < end && match[length] == p[length]) {
+      ++length;
+    }
+    putSequence(out, literals, static_cast<std::size_t>(p - literals),
+                static_cast<std::size_t>(p - match), length);
+    p += length;
+    literals = p;
+  }
+  putSequence(out, literals, static_cast<std::size_t>(end - literals), 0, 0);
+  return out;
+}
+
+bool lzDecompress(const std::string &input, std::size_t rawSize,
+                  std::string &output) {
+  if (rawSize > lzMaxRawSize(input.size())) {
+    return false;
+  }
+  try {
+    output.resize(rawSize);
+  } catch (const std::bad_alloc &) {
+    return false;
+  }
+  const auto *p = reinterpret_cast<const std::uint8_t *>(input.data());
+  const auto *end = p + input.size();
+  auto *outBegin = reinterpret_cast<std::uint8_t *>(&output[0]);
+  auto *out = outBegin;
+  auto *outEnd = outBegin + rawSize;
+  while (p < end) {
+    std::uint8_t token = *p++;
+    std::size_t literalLength = token >> 4;
+    if (literalLength == 15 && !getLength(p, end, literalLength)) {
+      return false;
+    }
+    if (literalLength > static_cast<std::size_t>(end - p) ||
+        literalLength > static_cast<std::size_t>(outEnd - out)) {
+      return false;
+    }
+    std::memcpy(out, p, literalLength);
+    p += literalLength;
+    out += literalLength;
+    if (p == end) {
+      break;
+    }
+    if (end - p < 2) {
+      return false;
+    }
+    std::size_t offset = p[0] | (static_cast<std::size_t>(p[1]) << 8);
+    p += 2;
+    std::size_t matchLength = token & 0x0f;
+    if (matchLength == 15 && !getLength(p, end, matchLength)) {
+      return false;
+    }
+    matchLength += MinMatch;
+    if (offset == 0 || offset > static_cast<std::size_t>(out - outBegin) ||
+        matchLength > static_cast<std::size_t>(outEnd - out)) {
+      return false;
+    }
+    // Matches may overlap their own output, so copy forwards byte by byte
+    const auto *match = out - offset;
+    for (std::size_t i = 0; i < matchLength; ++i) {
+      out[i] = match[i];
+    }
+    out += matchLength;
+  }
+  return out == outEnd;
+}
+}  // namespace padt::brep
@@ -0,0 +1,382 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include "geodesic.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <set>
+#include "parallel.h"
+
+namespace padt::brep {
+
+namespace {
+// Points closer than this fraction of the body diagonal are welded together
+constexpr double WeldTolerance = 1e-7;
+
+typedef std::array<std::int64_t, 3> Cell;
+
+struct CellHash {
+  std::size_t operator()(const Cell &c) const {
+    return static_cast<std::size_t>(c[0] * 73856093 ^ c[1] * 19349663 ^
+                                    c[2] * 83492791);
+  }
+};
+
+/**
+ * A uniform hash grid over welded points.  Each point records the edge or
+ * face whose geometry created it so that lookups can be restricted to
+ * topological neighbours.
+ */
+class WeldGrid {
+ public:
+  explicit WeldGrid(double tolerance) : Tolerance_(tolerance) {}
+
+  template <typename Accept>
+  int find(const Eigen::Vector3d &p,
+           const std::vector<Eigen::Vector3d> &points, Accept accept) const {
+    Cell c = cell(p);
+    for (std::int64_t dx = -1; dx <= 1; ++dx) {
+      for (std::int64_t dy = -1; dy <= 1; ++dy) {
+        for (std::int64_t dz = -1; dz <= 1; ++dz) {
+          auto it = Cells_.find({c[0] + dx, c[1] + dy, c[2] + dz});
+          if (it == Cells_.end()) {
+            continue;
+          }
+          for (int v : it->second) {
+            if ((points[v] - p).norm() <= Tolerance_ && accept(v)) {
+              return v;
+            }
+          }
+        }
+      }
+    }
+    return -1;
+  }
+  void insert(const Eigen::Vector3d &p, int v) { Cells_[cell(p)].push_back(v); }
+
+ private:
+  Cell cell(const Eigen::Vector3d &p) const {
+    return {static_cast<std::int64_t>(std::floor(p.x() / Tolerance_)),
+            static_cast<std::int64_t>(std::floor(p.y() / Tolerance_)),
+            static_cast<std::int64_t>(std::floor(p.z() / Tolerance_))};
+  }
+
+  double Tolerance_;
+  std::unordered_map<Cell, std::vector<int>, CellHash> Cells_;
+};
+
+double cotangent(const Eigen::Vector3d &a, const Eigen::Vector3d &b) {
+  return a.dot(b) / std::max(a.cross(b).norm(), 1e-300);
+}
+
+int findRoot(std::vector<int> &parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+}  // namespace
+
+GeodesicDistance::GeodesicDistance(const BRep &brep, const BodyHandle &h) {
+  weld(brep, h);
+  if (F_.rows() > 0) {
+    factorise();
+  }
+}
+
+void GeodesicDistance::weld(const BRep &brep, const BodyHandle &h) {
+  const auto &faces = brep.bodyFaces(h);
+  std::set<EdgeHandle> edges;
+  for (const auto &fh : faces) {
+    const auto &fEdges = brep.faceEdges(fh);
+    edges.insert(fEdges.begin(), fEdges.end());
+  }
+  auto box = brep.boundingBox(h);
+  double tolerance =
+      std::max(WeldTolerance * (box.isEmpty() ? 0.0 : box.diagonal().norm()),
+               std::numeric_limits<double>::min());
+  WeldGrid grid(tolerance);
+  std::vector<Eigen::Vector3d> points;
+  // The edge or face that created each point
+  std::vector<EdgeHandle> ownerEdge;
+  std::vector<FaceHandle> ownerFace;
+  auto addPoint = [&](const Eigen::Vector3d &p, const EdgeHandle &eh,
+                      const FaceHandle &fh) {
+    int v = static_cast<int>(points.size());
+    points.push_back(p);
+    ownerEdge.push_back(eh);
+    ownerFace.push_back(fh);
+    grid.insert(p, v);
+    return v;
+  };
+
+  // Edge curves first, so every face bounded by an edge snaps onto the same
+  // points.  Curves meeting at a vertex share their end points.
+  for (const auto &eh : edges) {
+    auto eV = brep.edgeGeometry(eh);
+    auto &mapping = EdgeVertices_[eh];
+    mapping.resize(eV.rows());
+    for (Eigen::Index i = 0; i < eV.rows(); ++i) {
+      Eigen::Vector3d p = eV.row(i).transpose();
+      int v = grid.find(p, points, [](int) { return true; });
+      mapping[i] = v >= 0 ? v : addPoint(p, eh, FaceHandle());
+    }
+  }
+
+  // Face points weld onto the curves of their own edges, or onto the points
+  // of faces across one of those edges when the curve is coarser than the
+  // face boundary
+  std::vector<std::array<int, 3>> triangles;
+  for (const auto &fh : faces) {
+    // Face edges keep their file order, so look them up through a set
+    const auto &fEdges = brep.faceEdges(fh);
+    std::set<EdgeHandle> ownEdges(fEdges.begin(), fEdges.end());
+    std::set<FaceHandle> neighbours;
+    for (const auto &eh : ownEdges) {
+      const auto &eFaces = brep.edgeFaces(eh);
+      neighbours.insert(eFaces.begin(), eFaces.end());
+    }
+    neighbours.erase(fh);
+    auto accept = [&](int v) {
+      if (ownerEdge[v].isValid()) {
+        return ownEdges.count(ownerEdge[v]) > 0;
+      }
+      return neighbours.count(ownerFace[v]) > 0;
+    };
+    auto [fV, fF] = brep.faceGeometry(fh);
+    auto &mapping = FaceVertices_[fh];
+    mapping.resize(fV.rows());
+    for (Eigen::Index i = 0; i < fV.rows(); ++i) {
+      Eigen::Vector3d p = fV.row(i).transpose();
+      int v = grid.find(p, points, accept);
+      mapping[i] = v >= 0 ? v : addPoint(p, EdgeHandle(), fh);
+    }
+    for (Eigen::Index t = 0; t < fF.rows(); ++t) {
+      std::array<int, 3> tri{mapping[fF(t, 0)], mapping[fF(t, 1)],
+                             mapping[fF(t, 2)]};
+      if (tri[0] != tri[1] && tri[1] != tri[2] && tri[2] != tri[0]) {
+        triangles.push_back(tri);
+      }
+    }
+  }
+
+  V_.resize(static_cast<Eigen::Index>(points.size()), 3);
+  for (std::size_t v = 0; v < points.size(); ++v) {
+    V_.row(static_cast<Eigen::Index>(v)) = points[v].transpose();
+  }
+  F_.resize(static_cast<Eigen::Index>(triangles.size()), 3);
+  std::vector<int> parent(points.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  for (std::size_t t = 0; t < triangles.size(); ++t) {
+    const auto &tri = triangles[t];
+    F_.row(static_cast<Eigen::Index>(t)) << tri[0], tri[1], tri[2];
+    parent[findRoot(parent, tri[1])] = findRoot(parent, tri[0]);
+    parent[findRoot(parent, tri[2])] = findRoot(parent, tri[0]);
+  }
+  Component_.assign(points.size(), -1);
+  std::vector<int> rootComponent(points.size(), -1);
+  ComponentCount_ = 0;
+  for (std::size_t v = 0; v < points.size(); ++v) {
+    int root = findRoot(parent, static_cast<int>(v));
+    if (rootComponent[root] < 0) {
+      rootComponent[root] = ComponentCount_++;
+    }
+    Component_[v] = rootComponent[root];
+  }
+}
+
+void GeodesicDistance::factorise() {
+  // Cotangent Laplacian, positive semi-definite, and lumped mass matrix
+  Eigen::Index n = V_.rows();
+  std::vector<Eigen::Triplet<double>> entries;
+  entries.reserve(static_cast<std::size_t>(F_.rows()) * 12);
+  Mass_ = Eigen::VectorXd::Zero(n);
+  double edgeLength = 0.0;
+  for (Eigen::Index t = 0; t < F_.rows(); ++t) {
+    for (int k = 0; k < 3; ++k) {
+      int i = F_(t, (k + 1) % 3);
+      int j = F_(t, (k + 2) % 3);
+      Eigen::Vector3d pk = V_.row(F_(t, k)).transpose();
+      double w = 0.5 * cotangent(V_.row(i).transpose() - pk,
+                                 V_.row(j).transpose() - pk);
+      entries.emplace_back(i, j, -w);
+      entries.emplace_back(j, i, -w);
+      entries.emplace_back(i, i, w);
+      entries.emplace_back(j, j, w);
+      edgeLength += (V_.row(i) - V_.row(j)).norm();
+    }
+    Eigen::Vector3d a = V_.row(F_(t, 0)).transpose();
+    double area = (V_.row(F_(t, 1)).transpose() - a)
+                      .cross(V_.row(F_(t, 2)).transpose() - a)
+                      .norm() /
+                  2.0;
+    for (int k = 0; k < 3; ++k) {
+      Mass_[F_(t, k)] += area / 3.0;
+    }
+  }
+  Eigen::SparseMatrix<double> L(n, n);
+  L.setFromTriplets(entries.begin(), entries.end());
+  Eigen::SparseMatrix<double> M(n, n);
+  std::vector<Eigen::Triplet<double>> diagonal;
+  diagonal.reserve(static_cast<std::size_t>(n));
+  for (Eigen::Index i = 0; i < n; ++i) {
+    // Isolated points get unit mass to keep both systems definite
+    diagonal.emplace_back(i, i, Mass_[i] > 0.0 ? Mass_[i] : 1.0);
+  }
+  M.setFromTriplets(diagonal.begin(), diagonal.end());
+
+  double h = edgeLength / (3.0 * static_cast<double>(F_.rows()));
+  TimeStep_ = h * h;
+  Heat_.compute(M + TimeStep_ * L);
+  // The Laplacian is singular on every connected piece; a small multiple of
+  // the mass matrix pins the free constant without changing the gradient
+  Poisson_.compute(L + (1e-8 / TimeStep_) * M);
+  Valid_ = Heat_.info() == Eigen::Success && Poisson_.info() == Eigen::Success;
+}
+
+Eigen::Index GeodesicDistance::closestVertex(const Eigen::Vector3d &p) const {
+  Eigen::Index closest = -1;
+  (V_.rowwise() - p.transpose()).rowwise().squaredNorm().minCoeff(&closest);
+  return closest;
+}
+
+Eigen::VectorXd GeodesicDistance::distance(
+    const GeodesicSources &sources) const {
+  if (!Valid_) {
+    return Eigen::VectorXd();
+  }
+  Eigen::Index n = V_.rows();
+  std::vector<int> seeds;
+  for (const auto &p : sources.Points_) {
+    seeds.push_back(static_cast<int>(closestVertex(p)));
+  }
+  for (const auto &eh : sources.Edges_) {
+    auto it = EdgeVertices_.find(eh);
+    if (it != EdgeVertices_.end()) {
+      seeds.insert(seeds.end(), it->second.begin(), it->second.end());
+    }
+  }
+  Eigen::VectorXd result =
+      Eigen::VectorXd::Constant(n, std::numeric_limits<double>::infinity());
+  if (seeds.empty()) {
+    return result;
+  }
+
+  // Diffuse heat from the seeds for a short time
+  Eigen::VectorXd delta = Eigen::VectorXd::Zero(n);
+  for (int s : seeds) {
+    delta[s] = 1.0;
+  }
+  Eigen::VectorXd u = Heat_.solve(delta);
+
+  // Normalised field pointing away from the seeds and its integrated
+  // divergence at every vertex
+  Eigen::VectorXd divergence = Eigen::VectorXd::Zero(n);
+  for (Eigen::Index t = 0; t < F_.rows(); ++t) {
+    std::array<Eigen::Vector3d, 3> p;
+    for (int k = 0; k < 3; ++k) {
+      p[k] = V_.row(F_(t, k)).transpose();
+    }
+    Eigen::Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
+    double doubleArea = normal.norm();
+    if (doubleArea <= 0.0) {
+      continue;
+    }
+    normal /= doubleArea;
+    Eigen::Vector3d gradient = Eigen::Vector3d::Zero();
+    for (int k = 0; k < 3; ++k) {
+      gradient +=
+          u[F_(t, k)] * normal.cross(p[(k + 2) % 3] - p[(k + 1) % 3]);
+    }
+    double norm = gradient.norm();
+    if (norm <= 0.0) {
+      continue;
+    }
+    Eigen::Vector3d X = -gradient / norm;
+    for (int k = 0; k < 3; ++k) {
+      const auto &pi = p[k];
+      const auto &pj = p[(k + 1) % 3];
+      const auto &pl = p[(k + 2) % 3];
+      double cotJ = cotangent(pi - pj, pl - pj);
+      double cotL = cotangent(pi - pl, pj - pl);
+      divergence[F_(t, k)] +=
+          0.5 * (cotL * (pj - pi).dot(X) + cotJ * (pl - pi).dot(X));
+    }
+  }
+
+  // Recover the distance whose gradient best matches the field and shift
+  // each connected piece so that its nearest seed is at zero
+  Eigen::VectorXd phi = Poisson_.solve(-divergence);
+  std::vector<double> offset(static_cast<std::size_t>(ComponentCount_),
+                             std::numeric_limits<double>::infinity());
+  for (int s : seeds) {
+    auto &o = offset[Component_[s]];
+    o = std::min(o, phi[s]);
+  }
+  for (Eigen::Index i = 0; i < n; ++i) {
+    double o = offset[Component_[i]];
+    if (std::isfinite(o)) {
+      result[i] = std::max(0.0, phi[i] - o);
+    }
+  }
+  return result;
+}
+
+std::vector<Eigen::VectorXd> GeodesicDistance::distances(
+    const std::vector<GeodesicSources> &sources) const {
+  std::vector<Eigen::VectorXd> results(sources.size());
+  // Solving with a factorisation only reads it, so the sets are independent
+  parallelFor(sources.size(),
+              [&](std::size_t i) { results[i] = distance(sources[i]); });
+  return results;
+}
+
+Eigen::VectorXd GeodesicDistance::faceDistances(
+    const FaceHandle &h, const Eigen::VectorXd &field) const {
+  auto it = FaceVertices_.find(h);
+  if (it == FaceVertices_.end() || field.size() != V_.rows()) {
+    return Eigen::VectorXd();
+  }
+  Eigen::VectorXd result(static_cast<Eigen::Index>(it->second.size()));
+  for (std::size_t i = 0; i < it->second.size(); ++i) {
+    result[static_cast<Eigen::Index>(i)] = field[it->second[i]];
+  }
+  return result;
+}
+
+Eigen::VectorXd GeodesicDistance::edgeDistances(
+    const EdgeHandle &h, const Eigen::VectorXd &field) const {
+  auto it = EdgeVertices_.find(h);
+  if (it == EdgeVertices_.end() || field.size() != V_.rows()) {
+    return Eigen::VectorXd();
+  }
+  Eigen::VectorXd result(static_cast<Eigen::Index>(it->second.size()));
+  for (std::size_t i = 0; i < it->second.size(); ++i) {
+    result[static_cast<Eigen::Index>(i)] = field[it->second[i]];
+  }
+  return result;
+}
+}  // namespace padt::brep
@@ -0,0 +1,301 @@
+/*
+ MIT License
+ Copyright (c) 2019 Matt Sutton
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ © 2019 GitHub, Inc.
+*/
+
+#include "queryService.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include "brep.pb.h"
+#include "query.pb.h"
+
+namespace padt::brep {
+
+namespace {
+// Most batches a worker takes from the queue in one dispatch
+constexpr std::size_t MaxCoalescedBatches = 64;
+
+void setBox(const Eigen::AlignedBox3d &box, padt::brep::proto::Box *out) {
+  out->mutable_min()->set_x(box.min().x());
+  out->mutable_min()->set_y(box.min().y());
+  out->mutable_min()->set_z(box.min().z());
+  out->mutable_max()->set_x(box.max().x());
+  out->mutable_max()->set_y(box.max().y());
+  out->mutable_max()->set_z(box.max().z());
+}
+
+template <typename PointsT, typename RepeatedT>
+void addPoints(const PointsT &points, RepeatedT *out) {
+  out->Reserve(static_cast<int>(points.rows()));
+  for (Eigen::Index row = 0; row < points.rows(); ++row) {
+    auto *p = out->Add();
+    p->set_x(points(row, 0));
+    p->set_y(points(row, 1));
+    p->set_z(points(row, 2));
+  }
+}
+
+template <typename HandlesT>
+void addHandles(const HandlesT &handles, padt::brep::proto::Handles *out) {
+  for (const auto &h : handles) {
+    out->add_ids(h.idx());
+  }
+}
+}  // namespace
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+  double us = std::chrono::duration<double, std::micro>(latency).count();
+  std::size_t bucket = 0;
+  if (us >= 1.0) {
+    bucket = static_cast<std::size_t>(std::floor(std::log2(us))) + 1;
+  }
+  bucket = std::min(bucket, Buckets - 1);
+  Counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::array<std::uint64_t, LatencyHistogram::Buckets> LatencyHistogram::counts()
+    const {
+  std::array<std::uint64_t, Buckets> result;
+  for (std::size_t i = 0; i < Buckets; ++i) {
+    result[i] = Counts_[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+std::uint64_t LatencyHistogram::count() const {
+  auto c = counts();
+  return std::accumulate(c.begin(), c.end(), std::uint64_t(0));
+}
+
+double LatencyHistogram::percentile(double p) const {
+  auto c = counts();
+  std::uint64_t total = std::accumulate(c.begin(), c.end(), std::uint64_t(0));
+  if (total == 0) {
+    return 0.0;
+  }
+  auto rank = static_cast<std::uint64_t>(std::ceil(p / 100.0 * total));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < Buckets; ++i) {
+    seen += c[i];
+    if (seen >= std::max<std::uint64_t>(rank, 1)) {
+      return bucketUpperBound(i);
+    }
+  }
+  return bucketUpperBound(Buckets - 1);
+}
+
+double LatencyHistogram::bucketUpperBound(std::size_t bucket) {
+  return std::ldexp(1.0, static_cast<int>(bucket));
+}
+
+QueryService::QueryService(const BRep &brep, std::size_t numThreads)
+    : BRep_(brep) {
+  BRep_.buildBoundingBoxCaches();
+  if (numThreads == 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < numThreads; ++i) {
+    Workers_.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+QueryService::~QueryService() { stop(); }
+
+void QueryService::stop() {
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Stopping_ = true;
+  }
+  Ready_.notify_all();
+  for (auto &w : Workers_) {
+    if (w.joinable()) {
+      w.join();
+    }
+  }
+}
+
+void QueryService::submit(padt::brep::proto::QueryBatch batch, Callback done) {
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (!Stopping_) {
+      Queue_.push_back(Work{std::move(batch), std::move(done),
+                            std::chrono::steady_clock::now()});
+      done = nullptr;
+    }
+  }
+  if (!done) {
+    Ready_.notify_one();
+    return;
+  }
+  // No worker is left to answer, so reject the batch on the calling thread
+  padt::brep::proto::QueryResultBatch rejected;
+  rejected.set_rejected(true);
+  done(std::move(rejected));
+}
+
+void QueryService::workerLoop() {
+  std::vector<Work> work;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(Mutex_);
+      Ready_.wait(lock, [this]() { return Stopping_ || !Queue_.empty(); });
+      // Drain the queue before stopping so no caller is left waiting
+      if (Queue_.empty()) {
+        return;
+      }
+      std::size_t n = std::min(Queue_.size(), MaxCoalescedBatches);
+      std::move(Queue_.begin(), Queue_.begin() + n, std::back_inserter(work));
+      Queue_.erase(Queue_.begin(), Queue_.begin() + n);
+    }
+    Dispatches_.fetch_add(1, std::memory_order_relaxed);
+    Batches_.fetch_add(work.size(), std::memory_order_relaxed);
+    for (auto &w : work) {
+      w.Done_(execute(w.Batch_));
+      Latencies_.record(std::chrono::steady_clock::now() - w.Submitted_);
+    }
+    work.clear();
+  }
+}
+
+padt::brep::proto::QueryResultBatch QueryService::execute(
+    const padt::brep::proto::QueryBatch &batch) const {
+  padt::brep::proto::QueryResultBatch results;
+  results.mutable_results()->Reserve(batch.queries_size());
+  for (const auto &query : batch.queries()) {
+    answer(query, *results.add_results());
+  }
+  return results;
+}
+
+void QueryService::answer(const padt::brep::proto::Query &query,
+                          padt::brep::proto::QueryResult &result) const {
+  using padt::brep::proto::EntityType;
+  using padt::brep::proto::TopologyQuery;
+  result.set_id(query.id());
+  if (query.has_bounding_box()) {
+    const auto &q = query.bounding_box();
+    int id = static_cast<int>(q.id());
+    Eigen::AlignedBox3d box;
+    switch (q.type()) {
+      case EntityType::ASSEMBLY:
+        box = BRep_.boundingBox(AssemblyHandle(id));
+        break;
+      case EntityType::PART:
+        box = BRep_.boundingBox(PartHandle(id));
+        break;
+      case EntityType::BODY:
+        box = BRep_.boundingBox(BodyHandle(id));
+        break;
+      case EntityType::FACE:
+        box = BRep_.boundingBox(FaceHandle(id));
+        break;
+      case EntityType::EDGE:
+        box = BRep_.boundingBox(EdgeHandle(id));
+        break;
+      case EntityType::VERTEX: {
+        auto vV = BRep_.vertexGeometry(VertexHandle(id));
+        if (vV.rows() > 0) {
+          box.extend(Eigen::Vector3d(vV.row(0).transpose()));
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    result.set_found(!box.isEmpty());
+    if (result.found()) {
+      setBox(box, result.mutable_box());
+    }
+  } else if (query.has_geometry()) {
+    const auto &q = query.geometry();
+    int id = static_cast<int>(q.id());
+    if (q.type() == EntityType::FACE) {
+      auto [fV, fF] = BRep_.faceGeometry(FaceHandle(id));
+      auto *surface = result.mutable_surface();
+      surface->set_id(id);
+      addPoints(fV, surface->mutable_points());
+      surface->mutable_triangles()->Reserve(static_cast<int>(fF.rows()));
+      for (Eigen::Index row = 0; row < fF.rows(); ++row) {
+        auto *t = surface->add_triangles();
+        t->set_i(fF(row, 0));
+        t->set_j(fF(row, 1));
+        t->set_k(fF(row, 2));
+      }
+      result.set_found(fV.rows() > 0);
+    } else if (q.type() == EntityType::EDGE) {
+      auto eV = BRep_.edgeGeometry(EdgeHandle(id));
+      auto eT = BRep_.edgeParameters(EdgeHandle(id));
+      auto *curve = result.mutable_curve();
+      curve->set_id(id);
+      addPoints(eV, curve->mutable_points());
+      for (Eigen::Index row = 0; row < eT.size(); ++row) {
+        curve->add_parameters(eT[row]);
+      }
+      result.set_found(eV.rows() > 0);
+    } else if (q.type() == EntityType::VERTEX) {
+      auto vV = BRep_.vertexGeometry(VertexHandle(id));
+      auto *curve = result.mutable_curve();
+      curve->set_id(id);
+      addPoints(vV, curve->mutable_points());
+      result.set_found(vV.rows() > 0);
+    }
+  } else if (query.has_topology()) {
+    const auto &q = query.topology();
+    int id = static_cast<int>(q.id());
+    auto *handles = result.mutable_handles();
+    switch (q.relation()) {
+      case TopologyQuery::ASSEMBLY_PARTS:
+        addHandles(BRep_.assemblyParts(AssemblyHandle(id)), handles);
+        break;
+      case TopologyQuery::PART_BODIES:
+        addHandles(BRep_.partBodies(PartHandle(id)), handles);
+        break;
+      case TopologyQuery::BODY_FACES:
+        addHandles(BRep_.bodyFaces(BodyHandle(id)), handles);
+        break;
+      case TopologyQuery::FACE_EDGES:
+        addHandles(BRep_.faceEdges(FaceHandle(id)), handles);
+        break;
+      case TopologyQuery::EDGE_VERTICES:
+        for (const auto &vH : {BRep_.startVertex(EdgeHandle(id)),
+                               BRep_.endVertex(EdgeHandle(id))}) {
+          if (vH.isValid()) {
+            handles->add_ids(vH.idx());
+          }
+        }
+        break;
+      case TopologyQuery::EDGE_FACES:
+        addHandles(BRep_.edgeFaces(EdgeHandle(id)), handles);
+        break;
+      case TopologyQuery::FACE_BODIES:
+        addHandles(BRep_.faceBodies(FaceHandle(id)), handles);
+        break;
+      case TopologyQuery::VERTEX_EDGES:
+        addHandles(BRep_.vertexEdges(VertexHandle(id)), handles);
+        break;
+      default:
+        break;
+    }
+    result.set_found(handles->ids_size() > 0);
+  }
+}
+}  // namespace padt::brep
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <boost/range/size.hpp>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "brep.h"
+#include "compression.h"
+#include "testModel.h"
+#include "utility.h"
+
+using padt::brep::BRep;
+using padt::brep::CompressionOptions;
+using padt::brep::EdgeHandle;
+using padt::brep::FaceHandle;
+using padt::brep::lzCompress;
+using padt::brep::lzDecompress;
+
+namespace {
+std::vector<padt::brep::proto::BRepEntity> readEntities(
+    const std::string &fileName) {
+  std::vector<padt::brep::proto::BRepEntity> entities;
+  std::ifstream in(fileName, std::ios::binary);
+  google::protobuf::io::IstreamInputStream pbin(&in);
+  padt::brep::proto::BRepEntity entity;
+  while (padt::pbio::readDelimitedFrom(&pbin, &entity)) {
+    entities.push_back(entity);
+    entity.Clear();
+  }
+  return entities;
+}
+
+std::string writeEntities(
+    const std::string &name,
+    const std::vector<padt::brep::proto::BRepEntity> &entities) {
+  std::string fileName = ::testing::TempDir() + name;
+  std::ofstream out(fileName, std::ios::binary);
+  google::protobuf::io::OstreamOutputStream pbout(&out);
+  for (const auto &e : entities) {
+    EXPECT_TRUE(padt::pbio::writeDelimitedTo(e, &pbout));
+  }
+  return fileName;
+}
+
+// A strip model written with the compressed encoding
+std::string writeCompressedStrip(const std::string &name,
+                                 const CompressionOptions &options,
+                                 BRep &brep) {
+  auto model = padt::brep::test::makeStripModel(6, 10);
+  EXPECT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  std::string fileName = ::testing::TempDir() + name;
+  EXPECT_TRUE(brep.writeCompressedBRepToFile(fileName, options));
+  return fileName;
+}
+}  // namespace
+
+TEST(LzCodec, RoundTrip) {
+  std::mt19937 rng(1);
+  for (int t = 0; t < 100; ++t) {
+    std::string input(rng() % 5000, 0);
+    for (auto &c : input) {
+      c = t % 2 ? static_cast<char>(rng()) : "abcab"[rng() % 5];
+    }
+    std::string output;
+    ASSERT_TRUE(lzDecompress(lzCompress(input), input.size(), output));
+    EXPECT_EQ(output, input);
+  }
+  std::string output;
+  EXPECT_TRUE(lzDecompress(lzCompress(""), 0, output));
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(LzCodec, RejectsCorruptInput) {
+  std::string input(4096, 'x');
+  std::string compressed = lzCompress(input);
+  std::string output;
+  EXPECT_FALSE(lzDecompress(compressed, input.size() - 1, output));
+  EXPECT_FALSE(lzDecompress(compressed, input.size() + 1, output));
+  EXPECT_FALSE(lzDecompress(compressed.substr(0, compressed.size() / 2),
+                            input.size(), output));
+  // A raw size the input cannot expand to fails without allocating it
+  EXPECT_FALSE(lzDecompress(compressed, std::size_t(1) << 62, output));
+}
+
+TEST(CompressedFile, RoundTrip) {
+  CompressionOptions options;
+  options.ChunkPoints_ = 200;
+  BRep original;
+  std::string fileName =
+      writeCompressedStrip("compressedRoundTrip.brep", options, original);
+  BRep loaded;
+  ASSERT_TRUE(loaded.buildBRepFromFile(fileName));
+  ASSERT_EQ(boost::size(loaded.faces()), boost::size(original.faces()));
+
+  // Positions share one grid over the largest extent of the model
+  double step = 6.0 / (std::ldexp(1.0, options.PositionBits_) - 1.0);
+  for (const auto fH : original.faces()) {
+    auto [oV, oF] = original.faceGeometry(fH);
+    auto [lV, lF] = loaded.faceGeometry(fH);
+    ASSERT_EQ(lV.rows(), oV.rows());
+    EXPECT_LE((lV - oV).cwiseAbs().maxCoeff(), 0.5 * step + 1e-12);
+    EXPECT_EQ(lF, oF);
+    EXPECT_LE((loaded.faceParameters(fH) - original.faceParameters(fH))
+                  .cwiseAbs()
+                  .maxCoeff(),
+              1e-6);
+  }
+  for (const auto eH : original.edges()) {
+    auto oV = original.edgeGeometry(eH);
+    auto lV = loaded.edgeGeometry(eH);
+    ASSERT_EQ(lV.rows(), oV.rows());
+    EXPECT_LE((lV - oV).cwiseAbs().maxCoeff(), 0.5 * step + 1e-12);
+    EXPECT_LE((loaded.edgeParameters(eH) - original.edgeParameters(eH))
+                  .cwiseAbs()
+                  .maxCoeff(),
+              1e-6);
+  }
+}
+
+TEST(CompressedFile, RejectsRepeatedChunks) {
+  BRep original;
+  auto entities = readEntities(
+      writeCompressedStrip("compressedRepeat.brep", CompressionOptions(),
+                           original));
+  std::vector<padt::brep::proto::BRepEntity> chunks;
+  for (const auto &e : entities) {
+    if (e.has_geometry_chunk()) {
+      chunks.push_back(e);
+    }
+  }
+  ASSERT_FALSE(chunks.empty());
+  {
+    // Two chunks decoding into the same faces and edges
+    auto repeated = entities;
+    repeated.push_back(chunks.front());
+    BRep brep;
+    EXPECT_FALSE(brep.buildBRepFromEntityStream(repeated));
+    EXPECT_FALSE(
+        brep.buildBRepFromFile(writeEntities("repeated.brep", repeated)));
+  }
+  {
+    // Counts the chunk data cannot hold
+    auto oversized = entities;
+    for (auto &e : oversized) {
+      if (e.has_geometry_chunk()) {
+        e.mutable_geometry_chunk()->set_point_count(std::int64_t(1) << 60);
+      }
+    }
+    BRep brep;
+    EXPECT_FALSE(brep.buildBRepFromEntityStream(oversized));
+    EXPECT_FALSE(
+        brep.buildBRepFromFile(writeEntities("oversized.brep", oversized)));
+  }
+}
+
+TEST(CompressedFile, RejectsOutOfRangeFacets) {
+  // The plain encoding does not check facets, so a bad index reaches a
+  // well formed chunk
+  auto model = padt::brep::test::makeStripModel(2, 4);
+  for (auto &e : model.Entities_) {
+    if (e.has_face() && e.face().id() == model.Faces_[1]) {
+      e.mutable_face()->mutable_surface()->mutable_triangles(0)->set_k(25);
+    }
+  }
+  BRep original;
+  ASSERT_TRUE(original.buildBRepFromEntityStream(model.Entities_));
+  std::string fileName = ::testing::TempDir() + "outOfRange.brep";
+  ASSERT_TRUE(original.writeCompressedBRepToFile(fileName));
+  BRep loaded;
+  EXPECT_FALSE(loaded.buildBRepFromFile(fileName));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "brep.h"
+#include "testModel.h"
+
+using padt::brep::AssemblyHandle;
+using padt::brep::BodyHandle;
+using padt::brep::BRep;
+using padt::brep::EdgeHandle;
+using padt::brep::FaceHandle;
+using padt::brep::PartHandle;
+
+namespace {
+bool sameGeometry(const BRep &a, const BRep &b) {
+  for (const auto fH : a.faces()) {
+    auto [aV, aF] = a.faceGeometry(fH);
+    auto [bV, bF] = b.faceGeometry(fH);
+    if (aV != bV || aF != bF || a.faceEdges(fH) != b.faceEdges(fH)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+TEST(BRepDelta, ReplaceInvalidatesBoundingBoxes) {
+  auto model = padt::brep::test::makeStripModel(3, 4);
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  // Fill every cache up the assembly chain first
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).max().z(), 0.0);
+
+  FaceHandle fH(model.Faces_[1]);
+  ASSERT_TRUE(brep.applyEntityDelta({padt::brep::test::makeStripFace(
+      fH.idx(), 1, 4, 5.0, model.Edges_[1], model.Edges_[2])}));
+  EXPECT_DOUBLE_EQ(brep.boundingBox(fH).max().z(), 5.0);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(BodyHandle(3)).max().z(), 5.0);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(PartHandle(2)).max().z(), 5.0);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).max().z(), 5.0);
+  // Untouched faces keep their geometry
+  EXPECT_DOUBLE_EQ(brep.boundingBox(FaceHandle(model.Faces_[0])).max().z(),
+                   0.0);
+}
+
+TEST(BRepDelta, RemoveFace) {
+  auto model = padt::brep::test::makeStripModel(3, 4);
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).max().x(), 3.0);
+
+  FaceHandle fH(model.Faces_[2]);
+  padt::brep::proto::BRepEntity removed;
+  removed.mutable_removed()->add_faces(fH.idx());
+  ASSERT_TRUE(brep.applyEntityDelta({removed}));
+
+  EXPECT_EQ(std::count(brep.faces().begin(), brep.faces().end(), fH), 0);
+  const auto &bodyFaces = brep.bodyFaces(BodyHandle(3));
+  EXPECT_EQ(std::count(bodyFaces.begin(), bodyFaces.end(), fH), 0);
+  const auto &edgeFaces = brep.edgeFaces(EdgeHandle(model.Edges_[2]));
+  EXPECT_EQ(edgeFaces.size(), 1u);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(BodyHandle(3)).max().x(), 2.0);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).max().x(), 2.0);
+}
+
+TEST(BRepDelta, CompactionKeepsGeometry) {
+  auto model = padt::brep::test::makeStripModel(3, 4);
+  BRep brep, rebuilt;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  // Replace every face several times over so that compaction runs
+  for (int round = 0; round < 4; ++round) {
+    std::vector<padt::brep::proto::BRepEntity> delta;
+    for (int i = 0; i < 3; ++i) {
+      delta.push_back(padt::brep::test::makeStripFace(
+          model.Faces_[i], i, 4, round, model.Edges_[i], model.Edges_[i + 1]));
+    }
+    ASSERT_TRUE(brep.applyEntityDelta(delta));
+  }
+  brep.compactGeometry();
+
+  auto expected = model.Entities_;
+  for (auto &e : expected) {
+    if (e.has_face()) {
+      for (auto &p : *e.mutable_face()->mutable_surface()->mutable_points()) {
+        p.set_z(3.0);
+      }
+    }
+  }
+  ASSERT_TRUE(rebuilt.buildBRepFromEntityStream(expected));
+  EXPECT_TRUE(sameGeometry(brep, rebuilt));
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).min().z(), 3.0);
+  EXPECT_DOUBLE_EQ(brep.boundingBox(AssemblyHandle(1)).max().z(), 3.0);
+}
@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "brep.h"
+#include "geodesic.h"
+#include "testModel.h"
+
+using padt::brep::BodyHandle;
+using padt::brep::BRep;
+using padt::brep::FaceHandle;
+using padt::brep::GeodesicDistance;
+using padt::brep::GeodesicSources;
+
+namespace {
+// Two 8 by 8 faces share the 9 points of their middle edge
+constexpr Eigen::Index WeldedPoints = 2 * 9 * 9 - 9;
+
+void expectWelded(bool reverseFaceEdges) {
+  auto model = padt::brep::test::makeStripModel(2, 8, reverseFaceEdges);
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  GeodesicDistance geodesic(brep, BodyHandle(3));
+  ASSERT_TRUE(geodesic.isValid());
+  EXPECT_EQ(geodesic.vertices().rows(), WeldedPoints);
+
+  GeodesicSources sources;
+  sources.Points_.push_back(Eigen::Vector3d(0.0, 0.0, 0.0));
+  auto field = geodesic.distance(sources);
+  auto far = geodesic.faceDistances(FaceHandle(model.Faces_[1]), field);
+  // The last grid point of the second face is the corner at (2, 1)
+  double d = far(far.size() - 1);
+  ASSERT_TRUE(std::isfinite(d));
+  EXPECT_NEAR(d, std::sqrt(5.0), 0.15 * std::sqrt(5.0));
+}
+}  // namespace
+
+TEST(GeodesicDistance, WeldsSortedFaceEdges) { expectWelded(false); }
+
+TEST(GeodesicDistance, WeldsUnsortedFaceEdges) { expectWelded(true); }
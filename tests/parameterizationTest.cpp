@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include "brep.h"
+#include "testModel.h"
+
+using padt::brep::BRep;
+using padt::brep::EdgeHandle;
+using padt::brep::FaceHandle;
+
+TEST(BRepParameterization, ParamAtPointInvertsPointAtParam) {
+  auto model = padt::brep::test::makeStripModel(2, 16);
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  FaceHandle fH(model.Faces_[1]);
+  Eigen::Matrix<double, Eigen::Dynamic, 2> uv(3, 2);
+  uv << 0.1, 0.2, 0.5, 0.5, 0.93, 0.71;
+  auto points = brep.pointsAtParams(fH, uv);
+  // Points off the surface project onto it
+  points.col(2).array() += 0.25;
+  auto params = brep.paramsAtPoints(fH, points);
+  EXPECT_LE((params - uv).cwiseAbs().maxCoeff(), 1e-12);
+
+  // Far points land on the nearest boundary
+  auto far = brep.paramAtPoint(fH, Eigen::Vector3d(1.5, -100.0, 0.0));
+  ASSERT_TRUE(far.has_value());
+  EXPECT_NEAR(far->x(), 0.5, 1e-12);
+  EXPECT_NEAR(far->y(), 0.0, 1e-12);
+}
+
+TEST(BRepParameterization, RejectsNonFiniteEdgeParameter) {
+  auto model = padt::brep::test::makeStripModel(1, 4);
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  EdgeHandle eH(model.Edges_[0]);
+  EXPECT_TRUE(brep.pointAtParam(eH, 0.5).has_value());
+  EXPECT_FALSE(
+      brep.pointAtParam(eH, std::numeric_limits<double>::quiet_NaN()));
+  EXPECT_FALSE(
+      brep.pointAtParam(eH, std::numeric_limits<double>::infinity()));
+}
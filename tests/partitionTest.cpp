@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <utility>
+#include "brep.h"
+#include "testModel.h"
+
+using padt::brep::BRep;
+
+namespace {
+// (record kind, id) for every entity in a stream
+std::set<std::pair<int, std::int64_t>> recordIds(
+    const std::vector<padt::brep::proto::BRepEntity> &entities) {
+  std::set<std::pair<int, std::int64_t>> ids;
+  for (const auto &e : entities) {
+    if (e.has_assembly()) ids.emplace(0, e.assembly().id());
+    if (e.has_part()) ids.emplace(1, e.part().id());
+    if (e.has_body()) ids.emplace(2, e.body().id());
+    if (e.has_face()) ids.emplace(3, e.face().id());
+    if (e.has_edge()) ids.emplace(4, e.edge().id());
+    if (e.has_vertex()) ids.emplace(5, e.vertex().id());
+  }
+  return ids;
+}
+}  // namespace
+
+TEST(BRepPartition, EveryEntityHasAChunk) {
+  auto model = padt::brep::test::makeStripModel(4, 4);
+  // An isolated vertex, an empty body in part 2, an empty part in assembly 1
+  // and an empty assembly
+  padt::brep::proto::BRepEntity vertex, body, part, assembly;
+  vertex.mutable_vertex()->set_id(200);
+  vertex.mutable_vertex()->mutable_point()->set_x(9.0);
+  body.mutable_body()->set_id(201);
+  model.Entities_[1].mutable_part()->add_bodies(201);
+  part.mutable_part()->set_id(202);
+  model.Entities_[0].mutable_assembly()->add_parts(202);
+  assembly.mutable_assembly()->set_id(203);
+  model.Entities_.insert(model.Entities_.end(),
+                         {vertex, body, part, assembly});
+
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  auto all = recordIds(brep.entityStream());
+  for (auto level : {padt::brep::PartitionLevel::Body,
+                     padt::brep::PartitionLevel::Face}) {
+    std::set<std::pair<int, std::int64_t>> covered;
+    for (const auto &p : brep.partition(2, level)) {
+      auto ids = recordIds(brep.entityStream(p));
+      covered.insert(ids.begin(), ids.end());
+    }
+    EXPECT_EQ(covered, all);
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef PADT_BREP_TEST_MODEL_H
+#define PADT_BREP_TEST_MODEL_H
+
+#include <cmath>
+#include <vector>
+#include "brep.pb.h"
+
+namespace padt::brep::test {
+/**
+ * A strip of unit square faces along x in assembly 1, part 2 and body 3.
+ * Face i spans [i, i + 1] and is tessellated as an n by n grid whose
+ * boundary points lie on the straight edges at x = i and x = i + 1.
+ */
+struct StripModel {
+  std::vector<padt::brep::proto::BRepEntity> Entities_;
+  std::vector<int> Faces_;
+  std::vector<int> Edges_;
+  std::vector<int> Vertices_;
+};
+
+inline padt::brep::proto::BRepEntity makeStripFace(int id, int i, int n,
+                                                   double z, int leftEdge,
+                                                   int rightEdge) {
+  padt::brep::proto::BRepEntity entity;
+  auto *face = entity.mutable_face();
+  face->set_id(id);
+  auto *surface = face->mutable_surface();
+  for (int r = 0; r <= n; ++r) {
+    for (int c = 0; c <= n; ++c) {
+      auto *p = surface->add_points();
+      p->set_x(i + double(c) / n);
+      p->set_y(double(r) / n);
+      p->set_z(z);
+      auto *uv = surface->add_parameters();
+      uv->set_u(double(c) / n);
+      uv->set_v(double(r) / n);
+    }
+  }
+  for (int r = 0; r < n; ++r) {
+    for (int c = 0; c < n; ++c) {
+      int v0 = r * (n + 1) + c;
+      int v2 = v0 + n + 1;
+      auto *t = surface->add_triangles();
+      t->set_i(v0);
+      t->set_j(v0 + 1);
+      t->set_k(v2 + 1);
+      t = surface->add_triangles();
+      t->set_i(v0);
+      t->set_j(v2 + 1);
+      t->set_k(v2);
+    }
+  }
+  face->add_edges(leftEdge);
+  face->add_edges(rightEdge);
+  auto *loop = face->add_loops();
+  loop->add_edges(leftEdge);
+  loop->add_edges(rightEdge);
+  return entity;
+}
+
+// With reverseFaceEdges each face lists its edges in descending id order,
+// as exporters are free to do
+inline StripModel makeStripModel(int faceCount, int n,
+                                 bool reverseFaceEdges = false) {
+  StripModel model;
+  padt::brep::proto::BRepEntity assembly, part, body;
+  assembly.mutable_assembly()->set_id(1);
+  assembly.mutable_assembly()->add_parts(2);
+  part.mutable_part()->set_id(2);
+  part.mutable_part()->add_bodies(3);
+  body.mutable_body()->set_id(3);
+  int id = 4;
+  std::vector<padt::brep::proto::BRepEntity> rest;
+  for (int i = 0; i <= faceCount; ++i) {
+    int start = id++;
+    int end = id++;
+    for (int j = 0; j < 2; ++j) {
+      padt::brep::proto::BRepEntity vertex;
+      vertex.mutable_vertex()->set_id(j == 0 ? start : end);
+      auto *p = vertex.mutable_vertex()->mutable_point();
+      p->set_x(i);
+      p->set_y(j);
+      model.Vertices_.push_back(vertex.vertex().id());
+      rest.push_back(vertex);
+    }
+    padt::brep::proto::BRepEntity edge;
+    edge.mutable_edge()->set_id(id++);
+    edge.mutable_edge()->set_start(start);
+    edge.mutable_edge()->set_end(end);
+    for (int k = 0; k <= n; ++k) {
+      auto *p = edge.mutable_edge()->mutable_curve()->add_points();
+      p->set_x(i);
+      p->set_y(double(k) / n);
+      edge.mutable_edge()->mutable_curve()->add_parameters(double(k) / n);
+    }
+    model.Edges_.push_back(edge.edge().id());
+    rest.push_back(edge);
+  }
+  for (int i = 0; i < faceCount; ++i) {
+    int left = model.Edges_[i];
+    int right = model.Edges_[i + 1];
+    if (reverseFaceEdges) {
+      std::swap(left, right);
+    }
+    rest.push_back(makeStripFace(id, i, n, 0.0, left, right));
+    model.Faces_.push_back(id);
+    body.mutable_body()->add_faces(id++);
+  }
+  model.Entities_ = {assembly, part, body};
+  model.Entities_.insert(model.Entities_.end(), rest.begin(), rest.end());
+  return model;
+}
+}  // namespace padt::brep::test
+#endif
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <boost/range/size.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "brep.h"
+#include "testModel.h"
+#include "utility.h"
+
+using padt::brep::AssemblyHandle;
+using padt::brep::BodyHandle;
+using padt::brep::BRep;
+using padt::brep::PartHandle;
+
+namespace {
+std::size_t countRecords(const std::string &fileName) {
+  std::ifstream in(fileName, std::ios::binary);
+  google::protobuf::io::IstreamInputStream pbin(&in);
+  padt::brep::proto::BRepEntity entity;
+  std::size_t count = 0;
+  while (padt::pbio::readDelimitedFrom(&pbin, &entity)) {
+    ++count;
+    entity.Clear();
+  }
+  return count;
+}
+
+// The strip model with a second, one face body 100 in part 2
+padt::brep::test::StripModel makeTwoBodyModel() {
+  auto model = padt::brep::test::makeStripModel(3, 4);
+  model.Entities_[1].mutable_part()->add_bodies(100);
+  padt::brep::proto::BRepEntity body;
+  body.mutable_body()->set_id(100);
+  body.mutable_body()->add_faces(101);
+  model.Entities_.push_back(body);
+  model.Entities_.push_back(padt::brep::test::makeStripFace(
+      101, 0, 4, 2.0, model.Edges_[0], model.Edges_[1]));
+  return model;
+}
+}  // namespace
+
+TEST(BRepWriter, FullRoundTrip) {
+  auto model = makeTwoBodyModel();
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  std::string fileName = ::testing::TempDir() + "writerFull.brep";
+  ASSERT_TRUE(brep.writeBRepToFile(fileName));
+  EXPECT_EQ(countRecords(fileName), model.Entities_.size());
+
+  BRep loaded;
+  ASSERT_TRUE(loaded.buildBRepFromFile(fileName));
+  EXPECT_EQ(loaded.assemblyParts(AssemblyHandle(1)),
+            brep.assemblyParts(AssemblyHandle(1)));
+  EXPECT_EQ(loaded.partBodies(PartHandle(2)), brep.partBodies(PartHandle(2)));
+  for (const auto bH : brep.bodies()) {
+    EXPECT_EQ(loaded.bodyFaces(bH), brep.bodyFaces(bH));
+  }
+  for (const auto fH : brep.faces()) {
+    EXPECT_EQ(loaded.faceEdges(fH), brep.faceEdges(fH));
+  }
+}
+
+TEST(BRepWriter, SubsetKeepsParents) {
+  auto model = makeTwoBodyModel();
+  BRep brep;
+  ASSERT_TRUE(brep.buildBRepFromEntityStream(model.Entities_));
+  std::string fileName = ::testing::TempDir() + "writerBody.brep";
+  ASSERT_TRUE(brep.writeBRepToFile(fileName, BodyHandle(100)));
+  // Assembly, part, body, face, its two edges and their four vertices
+  EXPECT_EQ(countRecords(fileName), 10u);
+
+  BRep loaded;
+  ASSERT_TRUE(loaded.buildBRepFromFile(fileName));
+  EXPECT_EQ(loaded.assemblyParts(AssemblyHandle(1)),
+            std::vector<PartHandle>{PartHandle(2)});
+  EXPECT_EQ(loaded.partBodies(PartHandle(2)),
+            std::vector<BodyHandle>{BodyHandle(100)});
+  EXPECT_EQ(loaded.bodyFaces(BodyHandle(100)), brep.bodyFaces(BodyHandle(100)));
+  EXPECT_EQ(boost::size(loaded.bodies()), 1);
+  EXPECT_EQ(boost::size(loaded.faces()), 1);
+
+  // A part subset gains its assembly
+  EXPECT_EQ(brep.entityStream(PartHandle(2)).size(), model.Entities_.size());
+}